@@ -0,0 +1,44 @@
+// every allocation made through operator new is counted so the frame stats
+// can show what the steady state update allocates. Clips are sampled from
+// any thread, so the counters are atomic
+global_variable std::atomic<u64> gAllocatedBytes;
+global_variable std::atomic<u64> gAllocationCount;
+
+inline void *CountedAllocate(size_t size)
+{
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size ? size : 1);
+    if(!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t size) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t size) noexcept
+{
+    free(memory);
+}
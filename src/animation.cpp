@@ -1,73 +1,468 @@
-struct AssimpNodeData
+// what the importer does to the keys of a clip, zero leaves them untouched
+struct AnimationImportSettings
 {
-    glm::mat4 transformation;
-    std::string name;
-    i32 childrenCount;
-    std::vector<AssimpNodeData> children;
+    f32 bakeRate;               // > 0 resamples every track to that many samples per second
+    KeyCompression compression; // replaces the float keys with quantized ones
+    f32 positionTolerance;      // model space distance a dropped key may move a bone
+    f32 rotationTolerance;      // radians a dropped key may turn a bone
+    b8 keepKeyTimes;            // every animated track keeps a time stamp per key
+    b8 fitCurves;               // the tolerances fit cubic curves instead of dropping linear keys
+    b8 ignoreCooked;            // the library imports the source even if a cooked file is up to date
 };
 
+// flattens the node tree depth first into a skeleton, so parents come
+// before their children and every subtree is contiguous. Only the hierarchy
+// and the bind transforms are filled in, the palette is bound once the clips
+// added their bones to the model
+internal void ReadSkeletonHierarchy(const aiNode *root, Skeleton *skeleton, std::vector<std::string> &nodeNames)
+{
+    Assert(root);
+    *skeleton = {};
+    nodeNames.clear();
+
+    std::vector<const aiNode *> nodes;
+    std::vector<i32> parents;
+    nodes.push_back(root);
+    parents.push_back(-1);
+    while(!nodes.empty())
+    {
+        const aiNode *src = nodes.back();
+        i32 parent = parents.back();
+        nodes.pop_back();
+        parents.pop_back();
+
+        i32 nodeIndex = AddSkeletonNode(*skeleton, parent, ConvertMatrixToGLMFormat(src->mTransformation));
+        nodeNames.push_back(src->mName.data);
+
+        // pushed in reverse so the children keep the order of the file
+        for(i32 i = (i32)src->mNumChildren - 1; i >= 0; --i)
+        {
+            nodes.push_back(src->mChildren[i]);
+            parents.push_back(nodeIndex);
+        }
+    }
+}
+
+// the palette covers every bone of the model, even the ones that are not
+// part of this hierarchy
+internal void BindSkeletonPalette(Skeleton *skeleton, const std::vector<std::string> &nodeNames,
+                                  const std::map<std::string, BoneInfo> &boneInfoMap)
+{
+    for(auto iter = boneInfoMap.begin(); iter != boneInfoMap.end(); ++iter)
+    {
+        skeleton->paletteCount = std::max(skeleton->paletteCount, iter->second.id + 1);
+    }
+
+    for(i32 nodeIndex = 0; nodeIndex < GetNodeCount(*skeleton); ++nodeIndex)
+    {
+        auto iter = boneInfoMap.find(nodeNames[nodeIndex]);
+        if(iter != boneInfoMap.end())
+        {
+            skeleton->paletteSlots[nodeIndex] = iter->second.id;
+            skeleton->inverseBindMatrices[nodeIndex] = iter->second.offset;
+        }
+    }
+}
+
+// the cooked form of the key and skeleton blocks, every array is written
+// as it is laid out in memory and read back with one copy
+internal void WriteCookedSkeleton(CookedWriter *writer, const Skeleton &skeleton)
+{
+    WriteCookedVector(writer, skeleton.parents);
+    WriteCookedVector(writer, skeleton.bindTransforms);
+    WriteCookedVector(writer, skeleton.inverseBindMatrices);
+    WriteCookedVector(writer, skeleton.paletteSlots);
+    WriteCookedValue(writer, skeleton.paletteCount);
+}
+
+internal void ReadCookedSkeleton(CookedReader *reader, Skeleton *skeleton)
+{
+    ReadCookedVector(reader, skeleton->parents);
+    ReadCookedVector(reader, skeleton->bindTransforms);
+    ReadCookedVector(reader, skeleton->inverseBindMatrices);
+    ReadCookedVector(reader, skeleton->paletteSlots);
+    ReadCookedValue(reader, &skeleton->paletteCount);
+}
+
+internal void WriteCookedBatches(CookedWriter *writer, const TrackBatches &batches)
+{
+    for(i32 kind = 0; kind < TRACK_KIND_COUNT; ++kind) WriteCookedVector(writer, batches.tracks[kind]);
+}
+
+internal void ReadCookedBatches(CookedReader *reader, TrackBatches *batches)
+{
+    for(i32 kind = 0; kind < TRACK_KIND_COUNT; ++kind) ReadCookedVector(reader, batches->tracks[kind]);
+}
+
+internal void WriteCookedKeys(CookedWriter *writer, const AnimationKeys &keys)
+{
+    WriteCookedVector(writer, keys.times);
+    WriteCookedVector(writer, keys.positions);
+    WriteCookedVector(writer, keys.rotations);
+    WriteCookedVector(writer, keys.scales);
+    WriteCookedVector(writer, keys.positionTracks);
+    WriteCookedVector(writer, keys.rotationTracks);
+    WriteCookedVector(writer, keys.scaleTracks);
+    WriteCookedVector(writer, keys.buckets);
+    WriteCookedVector(writer, keys.timelines);
+    WriteCookedBatches(writer, keys.timelineBatches);
+    WriteCookedValue(writer, keys.samplesPerTick);
+    WriteCookedBatches(writer, keys.positionBatches);
+    WriteCookedBatches(writer, keys.rotationBatches);
+    WriteCookedBatches(writer, keys.scaleBatches);
+}
+
+internal void ReadCookedKeys(CookedReader *reader, AnimationKeys *keys)
+{
+    ReadCookedVector(reader, keys->times);
+    ReadCookedVector(reader, keys->positions);
+    ReadCookedVector(reader, keys->rotations);
+    ReadCookedVector(reader, keys->scales);
+    ReadCookedVector(reader, keys->positionTracks);
+    ReadCookedVector(reader, keys->rotationTracks);
+    ReadCookedVector(reader, keys->scaleTracks);
+    ReadCookedVector(reader, keys->buckets);
+    ReadCookedVector(reader, keys->timelines);
+    ReadCookedBatches(reader, &keys->timelineBatches);
+    ReadCookedValue(reader, &keys->samplesPerTick);
+    ReadCookedBatches(reader, &keys->positionBatches);
+    ReadCookedBatches(reader, &keys->rotationBatches);
+    ReadCookedBatches(reader, &keys->scaleBatches);
+}
+
+internal void WriteCookedQuantizedKeys(CookedWriter *writer, const QuantizedKeys &keys)
+{
+    WriteCookedValue(writer, keys.compression);
+    WriteCookedValue(writer, keys.rotationStride);
+    WriteCookedVector(writer, keys.positions);
+    WriteCookedVector(writer, keys.rotations);
+    WriteCookedVector(writer, keys.scales);
+    WriteCookedVector(writer, keys.positionRanges);
+    WriteCookedVector(writer, keys.scaleRanges);
+}
+
+internal void ReadCookedQuantizedKeys(CookedReader *reader, QuantizedKeys *keys)
+{
+    ReadCookedValue(reader, &keys->compression);
+    ReadCookedValue(reader, &keys->rotationStride);
+    ReadCookedVector(reader, keys->positions);
+    ReadCookedVector(reader, keys->rotations);
+    ReadCookedVector(reader, keys->scales);
+    ReadCookedVector(reader, keys->positionRanges);
+    ReadCookedVector(reader, keys->scaleRanges);
+}
+
 class Animation
 {
 public:
     Animation() = default;
 
-    Animation(const std::string &animationPath, Model *model)
+    // builds one clip of an already imported scene on the hierarchy of its
+    // library. The clip only keeps which of its tracks animates each node,
+    // the skeleton must outlive it
+    Animation(const aiAnimation *animation, const Skeleton &skeleton, const std::vector<std::string> &nodeNames,
+              Model *model, const std::string &animationPath, const AnimationImportSettings &settings = {})
     {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
-        Assert(scene && scene->mRootNode);
-        auto animation = scene->mAnimations[0];
-        mDuration = (f32)animation->mDuration;
-        mTicksPerSecond = (f32)animation->mTicksPerSecond;
-        aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-        globalTransformation = globalTransformation.Inverse();
-        ReadHeirarchyData(mRootNode, scene->mRootNode);
-        ReadMissingBones(animation, *model);
+        Load(animation, skeleton, nodeNames, model, animationPath, settings);
     }
 
     ~Animation()
     {
     }
 
-    Bone *FindBone(const std::string &name)
+    // one track per channel of the clip, the ids and names of the bones
+    // are in the BoneInfo map and the skeleton binds its nodes to the tracks
+    inline i32 GetBoneCount() const
+    {
+        return (i32)mKeys.positionTracks.size();
+    }
+
+    inline const std::string &GetName() const
     {
-        auto iter = std::find_if(mBones.begin(), mBones.end(),
-                [&](const Bone &bone)
-                {
-                    return bone.GetBoneName() == name;
-                }
-        );
-        if(iter == mBones.end()) return nullptr;
-        else return &(*iter);
+        return mName;
     }
 
-    inline f32 GetTicksPerSecond()
+    inline f32 GetTicksPerSecond() const
     {
         return mTicksPerSecond;
     }
 
-    inline f32 GetDuration()
+    inline f32 GetDuration() const
     {
         return mDuration;
     }
 
-    inline const AssimpNodeData &GetRootNode()
+    inline const std::map<std::string, BoneInfo> &GetBoneIDMap() const
     {
-        return mRootNode;
+        return mBoneInfoMap;
     }
 
-    inline const std::map<std::string, BoneInfo> &GetBoneIDMap()
+    inline const Skeleton &GetSkeleton() const
     {
-        return mBoneInfoMap;
+        return *mSkeleton;
+    }
+
+    // the track that animates each node of the skeleton, -1 for none
+    inline const std::vector<i32> &GetNodeTracks() const
+    {
+        return mNodeTracks;
+    }
+
+    // size of the cursor array SamplePose takes
+    inline i32 GetTimelineCount() const
+    {
+        return (i32)mKeys.timelines.size();
+    }
+
+    inline bool IsBaked() const
+    {
+        return mKeys.samplesPerTick > 0.0f;
+    }
+
+    // the float keys the scalar samplers read, a quantized clip has none left
+    inline const AnimationKeys &GetKeys() const
+    {
+        Assert(!IsQuantized());
+        return mKeys;
+    }
+
+    inline bool IsQuantized() const
+    {
+        return mQuantizedKeys.compression != KEY_COMPRESSION_NONE;
+    }
+
+    inline const QuantizedKeys &GetQuantizedKeys() const
+    {
+        return mQuantizedKeys;
+    }
+
+    inline u64 GetKeyBytes() const
+    {
+        if(IsQuantized())
+            return GetAnimationKeyBytes(mKeys) + GetQuantizedKeyBytes(mQuantizedKeys);
+        return GetAnimationKeyBytes(mKeys);
+    }
+
+    // samples the animated tracks of every bone in one pass over the key
+    // blocks. The clip is never written after loading, all playback state
+    // lives in the cursors and the pose owned by the caller, so one clip can
+    // be sampled by any number of animators and threads at once. There is
+    // one cursor per timeline
+    void SamplePose(f32 animationTime, TimelineCursor *cursors, BoneTransform *localTransforms) const
+    {
+        if(IsQuantized())
+            SamplePoseQuantized(mKeys, mQuantizedKeys, animationTime, cursors, localTransforms);
+        else
+            SamplePoseBatched(mKeys, animationTime, cursors, localTransforms);
+    }
+
+    // SamplePose only writes the animated tracks, this puts the constant ones
+    // in a pose buffer once before it is first sampled
+    void SampleConstantTracks(BoneTransform *localTransforms) const
+    {
+        if(IsQuantized())
+            WriteConstantTracksQuantized(mKeys, mQuantizedKeys, localTransforms);
+        else
+            WriteConstantTracks(mKeys, localTransforms);
+    }
+
+    inline const TrackStats &GetTrackStats() const
+    {
+        return mTrackStats;
+    }
+
+    // everything the import built, LoadCooked reads it back in this order
+    void Cook(CookedWriter *writer) const
+    {
+        WriteCookedString(writer, mName);
+        WriteCookedValue(writer, mDuration);
+        WriteCookedValue(writer, mTicksPerSecond);
+        WriteCookedValue(writer, (i32)mBoneInfoMap.size());
+        for(auto iter = mBoneInfoMap.begin(); iter != mBoneInfoMap.end(); ++iter)
+        {
+            WriteCookedString(writer, iter->first);
+            WriteCookedValue(writer, iter->second);
+        }
+        WriteCookedKeys(writer, mKeys);
+        WriteCookedQuantizedKeys(writer, mQuantizedKeys);
+        WriteCookedValue(writer, mTrackStats);
+        WriteCookedVector(writer, mNodeTracks);
+    }
+
+    // false if the cooked data is cut off, the clip is unusable then
+    b8 LoadCooked(CookedReader *reader, const Skeleton *skeleton)
+    {
+        mSkeleton = skeleton;
+        ReadCookedString(reader, mName);
+        ReadCookedValue(reader, &mDuration);
+        ReadCookedValue(reader, &mTicksPerSecond);
+        i32 boneInfoCount = 0;
+        ReadCookedValue(reader, &boneInfoCount);
+        mBoneInfoMap.clear();
+        for(i32 infoIndex = 0; infoIndex < boneInfoCount && !reader->failed; ++infoIndex)
+        {
+            std::string name;
+            ReadCookedString(reader, name);
+            ReadCookedValue(reader, &mBoneInfoMap[name]);
+        }
+        ReadCookedKeys(reader, &mKeys);
+        ReadCookedQuantizedKeys(reader, &mQuantizedKeys);
+        ReadCookedValue(reader, &mTrackStats);
+        ReadCookedVector(reader, mNodeTracks);
+        if(mNodeTracks.size() != skeleton->parents.size()) reader->failed = true;
+        return !reader->failed;
     }
 
 private:
 
-    void ReadMissingBones(const aiAnimation *animation, Model &model)
+    void Load(const aiAnimation *animation, const Skeleton &skeleton, const std::vector<std::string> &nodeNames,
+              Model *model, const std::string &animationPath, const AnimationImportSettings &settings)
+    {
+        mName = animation->mName.data;
+        mDuration = (f32)animation->mDuration;
+        mTicksPerSecond = (f32)animation->mTicksPerSecond;
+        mSkeleton = &skeleton;
+        std::map<std::string, i32> trackIndices;
+        ReadMissingBones(animation, *model, trackIndices);
+        BindNodes(nodeNames, trackIndices);
+        FoldStaticTracks();
+        if(settings.positionTolerance > 0.0f || settings.rotationTolerance > 0.0f)
+        {
+            Reduce(settings.positionTolerance, settings.rotationTolerance, settings.fitCurves);
+        }
+        if(settings.bakeRate > 0.0f)
+        {
+            Bake(animationPath, settings.bakeRate);
+        }
+        if(!settings.keepKeyTimes)
+        {
+            ClassifyTracks();
+        }
+        CountTrackKinds();
+        ShareKeyTimes();
+        mQuantizedKeys = {};
+        if(settings.compression != KEY_COMPRESSION_NONE)
+        {
+            Quantize(settings.compression);
+        }
+        BuildTrackBatches(mKeys);
+        BuildKeyBuckets(mKeys);
+    }
+
+    // single key for every constant track. The bones that never move keep
+    // their track, it is written to the pose once and never sampled again
+    void FoldStaticTracks()
+    {
+        AnimationKeys folded;
+        FoldConstantTracks(mKeys, &folded, &mTrackStats);
+        mKeys = folded;
+
+        mTrackStats.staticBones = 0;
+        for(i32 trackIndex : mNodeTracks)
+        {
+            if(trackIndex >= 0 && IsStaticTrack(mKeys, trackIndex)) ++mTrackStats.staticBones;
+        }
+    }
+
+    void Bake(const std::string &animationPath, f32 bakeRate)
+    {
+        if(mTicksPerSecond <= 0.0f)
+        {
+            printf("Cannot bake %s, the clip has no tick rate\n", animationPath.c_str());
+            return;
+        }
+
+        AnimationKeys baked;
+        TrackStats &stats = mTrackStats;
+        BakeAnimationKeys(mKeys, bakeRate / mTicksPerSecond, mDuration, &baked,
+                          &stats.bakePositionError, &stats.bakeRotationError);
+        mKeys = baked;
+
+        // constant tracks keep a single key, count the animated ones
+        stats.bakedSamples = 0;
+        for(const AnimationTrack &track : mKeys.rotationTracks) stats.bakedSamples = std::max(stats.bakedSamples, track.numKeys);
+        for(const AnimationTrack &track : mKeys.positionTracks) stats.bakedSamples = std::max(stats.bakedSamples, track.numKeys);
+    }
+
+    void ClassifyTracks()
+    {
+        AnimationKeys classified;
+        ClassifyTrackKinds(mKeys, &classified);
+        mKeys = classified;
+    }
+
+    // the kinds the tracks ended up with, all variable or cubic when the
+    // key times were kept
+    void CountTrackKinds()
+    {
+        i32 *counts = mTrackStats.kinds;
+        for(i32 kind = 0; kind < TRACK_KIND_COUNT; ++kind) counts[kind] = 0;
+        const std::vector<AnimationTrack> *tables[] = { &mKeys.positionTracks, &mKeys.rotationTracks, &mKeys.scaleTracks };
+        for(const std::vector<AnimationTrack> *tracks : tables)
+        {
+            for(const AnimationTrack &track : *tracks) counts[track.kind]++;
+        }
+    }
+
+    void ShareKeyTimes()
+    {
+        TrackStats &stats = mTrackStats;
+        stats.sourceTimes = (i32)mKeys.times.size();
+        ShareTimelines(mKeys);
+
+        stats.timelines = (i32)mKeys.timelines.size();
+        stats.searchedTimelines = 0;
+        for(const AnimationTrack &timeline : mKeys.timelines)
+        {
+            if(timeline.kind != TRACK_KIND_CONSTANT && timeline.kind != TRACK_KIND_LINEAR_UNIFORM) ++stats.searchedTimelines;
+        }
+        stats.sharedTimes = (i32)mKeys.times.size();
+    }
+
+    void Reduce(f32 positionTolerance, f32 rotationTolerance, bool fitCurves)
+    {
+        // how far the subtree of every bone reaches, bones that are not
+        // part of the hierarchy only get the plain tolerances
+        std::vector<f32> nodeReaches;
+        GetSkeletonReach(*mSkeleton, nodeReaches);
+        std::vector<f32> reaches(GetBoneCount(), 0.0f);
+        for(i32 nodeIndex = 0; nodeIndex < GetNodeCount(*mSkeleton); ++nodeIndex)
+        {
+            i32 track = mNodeTracks[nodeIndex];
+            if(track >= 0) reaches[track] = nodeReaches[nodeIndex];
+        }
+
+        AnimationKeys reduced;
+        if(fitCurves)
+            FitCubicTracks(mKeys, reaches.data(), positionTolerance, rotationTolerance, &reduced);
+        else
+            ReduceAnimationKeys(mKeys, reaches.data(), positionTolerance, rotationTolerance, &reduced);
+
+        mTrackStats.sourceKeys = (i32)(mKeys.positions.size() + mKeys.rotations.size() + mKeys.scales.size());
+        mTrackStats.reducedKeys = (i32)(reduced.positions.size() + reduced.rotations.size() + reduced.scales.size());
+        mKeys = reduced;
+    }
+
+    void Quantize(KeyCompression compression)
+    {
+        TrackStats &stats = mTrackStats;
+        stats.floatKeyBytes = GetAnimationKeyBytes(mKeys);
+        QuantizeAnimationKeys(mKeys, compression, &mQuantizedKeys, &stats.quantizePositionError,
+                              &stats.quantizeRotationError, &stats.quantizeScaleError);
+
+        // only the tracks and times are still read from the float keys
+        mKeys.positions = std::vector<glm::vec3>();
+        mKeys.rotations = std::vector<glm::quat>();
+        mKeys.scales = std::vector<glm::vec3>();
+    }
+
+    // the track of every channel by name, only needed until the nodes are bound
+    void ReadMissingBones(const aiAnimation *animation, Model &model, std::map<std::string, i32> &trackIndices)
     {
         i32 size = animation->mNumChannels;
         auto &boneInfoMap = model.GetBoneInfoMap();
         i32 &boneCount = model.GetBoneCount();
+        mKeys = {};
 
         for(i32 i = 0; i < size; ++i)
         {
@@ -76,37 +471,37 @@ private:
 
             if(boneInfoMap.find(boneName) == boneInfoMap.end())
             {
+                // no vertex is skinned to it, identity keeps the palette affine
                 boneInfoMap[boneName].id = boneCount;
+                boneInfoMap[boneName].offset = glm::mat4(1.0f);
                 boneCount++;
             }
-            mBones.push_back(Bone(channel->mNodeName.data,
-                                  boneInfoMap[channel->mNodeName.data].id,
-                                  channel));
+            trackIndices.emplace(boneName, i);
+            AddChannelTracks(mKeys, channel);
         }
 
         mBoneInfoMap = boneInfoMap;
     }
 
-    void ReadHeirarchyData(AssimpNodeData &dest, const aiNode *src)
+    // resolves the names of the hierarchy once so playback only deals with indices
+    void BindNodes(const std::vector<std::string> &nodeNames, const std::map<std::string, i32> &trackIndices)
     {
-        Assert(src);
-
-        dest.name = src->mName.data;
-        dest.transformation = ConvertMatrixToGLMFormat(src->mTransformation);
-        dest.childrenCount = src->mNumChildren;
-
-        for(u32 i = 0; i < src->mNumChildren; ++i)
+        mNodeTracks.assign(GetNodeCount(*mSkeleton), -1);
+        for(i32 nodeIndex = 0; nodeIndex < GetNodeCount(*mSkeleton); ++nodeIndex)
         {
-            AssimpNodeData newData;
-            ReadHeirarchyData(newData, src->mChildren[i]);
-            dest.children.push_back(newData);
+            auto track = trackIndices.find(nodeNames[nodeIndex]);
+            if(track != trackIndices.end()) mNodeTracks[nodeIndex] = track->second;
         }
     }
 
     f32 mDuration;
     f32 mTicksPerSecond;
-    std::vector<Bone> mBones;
-    AssimpNodeData mRootNode;
+    AnimationKeys mKeys;
+    QuantizedKeys mQuantizedKeys;
+    TrackStats mTrackStats;
     std::map<std::string, BoneInfo> mBoneInfoMap;
+    const Skeleton *mSkeleton = nullptr;
+    std::vector<i32> mNodeTracks;
+    std::string mName;
 
 };
@@ -1,17 +1,11 @@
 class Animator
 {
 public:
-    Animator(Animation *animation)
+    Animator(const Animation *animation)
     {
         mCurrentTime = 0.0f;
         mCurrentAnimation = animation;
-
-        mFinalBoneMatrices.reserve(100);
-
-        for(i32 i = 0; i < 100; ++i)
-        {
-            mFinalBoneMatrices.push_back(glm::mat4(1.0f));
-        }
+        ResetPlaybackState();
     }
 
     void UpdateAnimation(f32 dt)
@@ -21,52 +15,84 @@ public:
         {
             mCurrentTime += mCurrentAnimation->GetTicksPerSecond() * dt;
             mCurrentTime = fmodf(mCurrentTime, mCurrentAnimation->GetDuration());
-            CalculateBoneTransform(&mCurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+            mCurrentAnimation->SamplePose(mCurrentTime, mCursors.data(), mLocalPose.data());
+            CalculateBoneTransforms();
         }
     }
 
-    void PlayAnimation(Animation *animation)
+    void PlayAnimation(const Animation *animation)
     {
         mCurrentAnimation = animation;
         mCurrentTime = 0.0f;
+        ResetPlaybackState();
     }
 
-    void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+    // walks the flat skeleton parents first, nothing in here allocates. The
+    // local pose becomes a matrix in one step and the hierarchy is composed
+    // with affine products, the full 4x4 product is never needed
+    void CalculateBoneTransforms()
     {
-        std::string nodeName = node->name;
-        glm::mat4 nodeTransform = node->transformation;
-
-        Bone *bone = mCurrentAnimation->FindBone(nodeName);
-
-        if(bone)
+        const Skeleton &skeleton = mCurrentAnimation->GetSkeleton();
+        const i32 *nodeTracks = mCurrentAnimation->GetNodeTracks().data();
+        i32 nodeCount = GetNodeCount(skeleton);
+        for(i32 nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex)
         {
-            bone->Update(mCurrentTime);
-            nodeTransform = bone->GetLocalTransform();
-        }
+            i32 trackIndex = nodeTracks[nodeIndex];
+            glm::mat4 nodeTransform;
+            if(trackIndex >= 0)
+                nodeTransform = ComposeAffine(mLocalPose[trackIndex]);
+            else
+                nodeTransform = skeleton.bindTransforms[nodeIndex];
 
-        glm::mat4 globalTransformation = parentTransform * nodeTransform;
+            i32 parent = skeleton.parents[nodeIndex];
+            if(parent >= 0)
+                mModelPose[nodeIndex] = MultiplyAffine(mModelPose[parent], nodeTransform);
+            else
+                mModelPose[nodeIndex] = nodeTransform;
 
-        auto boneInfoMap = mCurrentAnimation->GetBoneIDMap();
-        if(boneInfoMap.find(nodeName) != boneInfoMap.end())
-        {
-            i32 index = boneInfoMap[nodeName].id;
-            glm::mat4 offset = boneInfoMap[nodeName].offset;
-            mFinalBoneMatrices[index] = globalTransformation * offset;
+            i32 boneID = skeleton.paletteSlots[nodeIndex];
+            if(boneID >= 0)
+            {
+                mFinalBoneMatrices[boneID] = MultiplyAffine(mModelPose[nodeIndex], skeleton.inverseBindMatrices[nodeIndex]);
+            }
         }
+    }
 
-        for(i32 i = 0; i < node->childrenCount; ++i)
-        {
-            CalculateBoneTransform(&node->children[i], globalTransformation);
-        }
+    // view of the palette owned by the animator, valid until the next
+    // PlayAnimation call
+    const glm::mat4 *GetFinalBoneMatrices() const
+    {
+        return mFinalBoneMatrices.data();
     }
 
-    std::vector<glm::mat4> GetFinalBoneMatrices()
+    i32 GetFinalBoneCount() const
     {
-        return mFinalBoneMatrices;
+        return (i32)mFinalBoneMatrices.size();
     }
 private:
+    void ResetPlaybackState()
+    {
+        mCursors.clear();
+        mLocalPose.clear();
+        mModelPose.clear();
+        mFinalBoneMatrices.clear();
+        if(mCurrentAnimation)
+        {
+            mFinalBoneMatrices.resize(mCurrentAnimation->GetSkeleton().paletteCount, glm::mat4(1.0f));
+            mCursors.resize(mCurrentAnimation->GetTimelineCount(), TimelineCursor{});
+            mLocalPose.resize(mCurrentAnimation->GetBoneCount(), BoneTransform{glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)});
+            mModelPose.resize(GetNodeCount(mCurrentAnimation->GetSkeleton()), glm::mat4(1.0f));
+            mCurrentAnimation->SampleConstantTracks(mLocalPose.data());
+        }
+    }
+
     std::vector<glm::mat4> mFinalBoneMatrices;
-    Animation *mCurrentAnimation;
+    std::vector<TimelineCursor> mCursors;
+    // local transform of every bone of the clip, sampled by this animator
+    std::vector<BoneTransform> mLocalPose;
+    // model space transform of every node of the skeleton
+    std::vector<glm::mat4> mModelPose;
+    const Animation *mCurrentAnimation;
     f32 mCurrentTime;
     f32 mDeltaTime;
 };
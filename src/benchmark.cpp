@@ -0,0 +1,923 @@
+// Offline benchmarks, run with: sdl_platform.exe --bench
+// they load the clips through the same code path the game uses and print
+// the results to the console
+
+#define BENCHMARK_LOOPS 200
+#define BENCHMARK_SCRUB_SAMPLES 20000
+#define BENCHMARK_COLD_SAMPLES 500
+#define BENCHMARK_CACHE_LINE 64
+#define BENCHMARK_FLUSH_SIZE Megabyte(64)
+
+inline f64 GetMilliseconds(u64 start, u64 end)
+{
+    return (f64)(end - start) * 1000.0 / (f64)SDL_GetPerformanceFrequency();
+}
+
+enum KeyLookup
+{
+    KEY_LOOKUP_SCAN,    // linear scan from the first key
+    KEY_LOOKUP_CURSOR,  // cursor walk, time index when it is too far away
+    KEY_LOOKUP_BUCKETS, // time index of the track, no cursor
+    KEY_LOOKUP_COUNT
+};
+
+internal i64 LookupTrackKeys(const AnimationKeys &keys, const std::vector<AnimationTrack> &tracks,
+                             f32 time, KeyLookup lookup, i32 *cursors, i64 *count)
+{
+    i64 sum = 0;
+    for(u32 trackIndex = 0; trackIndex < tracks.size(); ++trackIndex)
+    {
+        const AnimationTrack &track = tracks[trackIndex];
+        if(track.kind != TRACK_KIND_LINEAR_VARIABLE) continue;
+
+        const f32 *times = &keys.times[track.timeOffset];
+        if(KEY_LOOKUP_CURSOR == lookup)
+            sum += FindTrackKeyIndex(keys, track, time, cursors[trackIndex]);
+        else if(KEY_LOOKUP_BUCKETS == lookup)
+            sum += FindTrackKeyIndex(keys, track, time);
+        else
+            sum += FindKeyIndexLinear(times, track.numKeys, time);
+        ++*count;
+    }
+    return sum;
+}
+
+internal f64 BenchmarkKeyLookups(const Animation *animation, const std::vector<f32> &times, KeyLookup lookup, i64 *checksum, i64 *lookups)
+{
+    const AnimationKeys &keys = animation->GetKeys();
+    std::vector<i32> positionCursors(keys.positionTracks.size(), 0);
+    std::vector<i32> rotationCursors(keys.rotationTracks.size(), 0);
+    std::vector<i32> scaleCursors(keys.scaleTracks.size(), 0);
+
+    i64 sum = 0;
+    i64 count = 0;
+    u64 start = SDL_GetPerformanceCounter();
+    for(u32 timeIndex = 0; timeIndex < times.size(); ++timeIndex)
+    {
+        f32 time = times[timeIndex];
+        sum += LookupTrackKeys(keys, keys.positionTracks, time, lookup, positionCursors.data(), &count);
+        sum += LookupTrackKeys(keys, keys.rotationTracks, time, lookup, rotationCursors.data(), &count);
+        sum += LookupTrackKeys(keys, keys.scaleTracks, time, lookup, scaleCursors.data(), &count);
+    }
+    u64 end = SDL_GetPerformanceCounter();
+
+    *checksum = sum;
+    *lookups = count;
+    return GetMilliseconds(start, end);
+}
+
+internal void PrintKeyLookupResult(const char *name, const Animation *animation, const std::vector<f32> &times)
+{
+    f64 nsPerLookup[KEY_LOOKUP_COUNT];
+    i64 checksums[KEY_LOOKUP_COUNT];
+    for(i32 lookup = 0; lookup < KEY_LOOKUP_COUNT; ++lookup)
+    {
+        i64 lookups;
+        f64 ms = BenchmarkKeyLookups(animation, times, (KeyLookup)lookup, &checksums[lookup], &lookups);
+        nsPerLookup[lookup] = ms * 1000000.0 / (f64)(lookups > 0 ? lookups : 1);
+    }
+    Assert(checksums[KEY_LOOKUP_SCAN] == checksums[KEY_LOOKUP_CURSOR]);
+    Assert(checksums[KEY_LOOKUP_SCAN] == checksums[KEY_LOOKUP_BUCKETS]);
+
+    printf("  %-10s scan %8.2f ns/lookup | cursor %8.2f ns/lookup | buckets %8.2f ns/lookup\n", name,
+           nsPerLookup[KEY_LOOKUP_SCAN], nsPerLookup[KEY_LOOKUP_CURSOR], nsPerLookup[KEY_LOOKUP_BUCKETS]);
+}
+
+internal void BenchmarkKeyCursors(const Animation *animation)
+{
+    f32 duration = animation->GetDuration();
+    f32 step = animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+
+    // normal playback at the target frame rate, looping the clip
+    std::vector<f32> playback;
+    f32 time = 0.0f;
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * duration / step);
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        playback.push_back(time);
+        time = fmodf(time + step, duration);
+    }
+
+    // random access, the worst case for the cursors
+    std::vector<f32> scrub;
+    srand(1234);
+    for(i32 sample = 0; sample < BENCHMARK_SCRUB_SAMPLES; ++sample)
+    {
+        scrub.push_back(duration * ((f32)rand() / (f32)RAND_MAX) * 0.999f);
+    }
+
+    printf("Key lookup (%d bones, %.1f ticks):\n", animation->GetBoneCount(), duration);
+    PrintKeyLookupResult("playback", animation, playback);
+    PrintKeyLookupResult("scrub", animation, scrub);
+}
+
+// the per bone layout clips had before the key blocks, every bone owns three
+// heap vectors with the time stamp stored next to each value
+struct LegacyKeyPosition
+{
+    glm::vec3 position;
+    f32 timeStamp;
+};
+
+struct LegacyKeyRotation
+{
+    glm::quat orientation;
+    f32 timeStamp;
+};
+
+struct LegacyKeyScale
+{
+    glm::vec3 scale;
+    f32 timeStamp;
+};
+
+struct LegacyBone
+{
+    std::vector<LegacyKeyPosition> positions;
+    std::vector<LegacyKeyRotation> rotations;
+    std::vector<LegacyKeyScale> scales;
+    glm::mat4 localTransform;
+    std::string name;
+    i32 id;
+};
+
+// same search as FindKeyIndex but over keys that carry their own time stamp
+template <typename Key>
+i32 LegacyFindKeyIndex(const std::vector<Key> &keys, f32 animationTime, i32 &cursor)
+{
+    i32 numKeys = (i32)keys.size();
+    i32 lastIndex = numKeys - 2;
+    i32 index = cursor;
+    if(index < 0 || index > lastIndex)
+    {
+        index = 0;
+    }
+
+    i32 steps = 0;
+    while(index < lastIndex && animationTime >= keys[index + 1].timeStamp && steps++ < KEY_CURSOR_MAX_STEPS)
+    {
+        ++index;
+    }
+    while(index > 0 && animationTime < keys[index].timeStamp && steps++ < KEY_CURSOR_MAX_STEPS)
+    {
+        --index;
+    }
+    if(steps > KEY_CURSOR_MAX_STEPS)
+    {
+        i32 low = 1;
+        i32 high = numKeys - 1;
+        while(low < high)
+        {
+            i32 middle = low + (high - low) / 2;
+            if(animationTime < keys[middle].timeStamp)
+                high = middle;
+            else
+                low = middle + 1;
+        }
+        index = low - 1;
+    }
+
+    cursor = index;
+    return index;
+}
+
+internal void BuildLegacyBones(const Animation *animation, std::vector<LegacyBone> &bones)
+{
+    const AnimationKeys &keys = animation->GetKeys();
+
+    // the name and id the old per bone objects carried, looked up through
+    // the node the track animates
+    std::vector<i32> ids(animation->GetBoneCount(), -1);
+    const Skeleton &skeleton = animation->GetSkeleton();
+    const std::vector<i32> &nodeTracks = animation->GetNodeTracks();
+    for(i32 nodeIndex = 0; nodeIndex < GetNodeCount(skeleton); ++nodeIndex)
+    {
+        if(nodeTracks[nodeIndex] >= 0) ids[nodeTracks[nodeIndex]] = skeleton.paletteSlots[nodeIndex];
+    }
+
+    for(i32 boneIndex = 0; boneIndex < animation->GetBoneCount(); ++boneIndex)
+    {
+        LegacyBone bone;
+        bone.id = ids[boneIndex];
+        for(auto iter = animation->GetBoneIDMap().begin(); iter != animation->GetBoneIDMap().end(); ++iter)
+        {
+            if(iter->second.id == bone.id) bone.name = iter->first;
+        }
+        bone.localTransform = glm::mat4(1.0f);
+
+        const AnimationTrack &positionTrack = keys.positionTracks[boneIndex];
+        for(i32 keyIndex = 0; keyIndex < positionTrack.numKeys; ++keyIndex)
+        {
+            LegacyKeyPosition key;
+            key.position = keys.positions[positionTrack.keyOffset + keyIndex];
+            key.timeStamp = keys.times[positionTrack.timeOffset + keyIndex];
+            bone.positions.push_back(key);
+        }
+
+        const AnimationTrack &rotationTrack = keys.rotationTracks[boneIndex];
+        for(i32 keyIndex = 0; keyIndex < rotationTrack.numKeys; ++keyIndex)
+        {
+            LegacyKeyRotation key;
+            key.orientation = keys.rotations[rotationTrack.keyOffset + keyIndex];
+            key.timeStamp = keys.times[rotationTrack.timeOffset + keyIndex];
+            bone.rotations.push_back(key);
+        }
+
+        const AnimationTrack &scaleTrack = keys.scaleTracks[boneIndex];
+        for(i32 keyIndex = 0; keyIndex < scaleTrack.numKeys; ++keyIndex)
+        {
+            LegacyKeyScale key;
+            key.scale = keys.scales[scaleTrack.keyOffset + keyIndex];
+            key.timeStamp = keys.times[scaleTrack.timeOffset + keyIndex];
+            bone.scales.push_back(key);
+        }
+
+        bones.push_back(bone);
+    }
+}
+
+internal void SampleLegacyPose(std::vector<LegacyBone> &bones, f32 time, BoneCursor *cursors)
+{
+    for(u32 boneIndex = 0; boneIndex < bones.size(); ++boneIndex)
+    {
+        LegacyBone &bone = bones[boneIndex];
+        BoneCursor &cursor = cursors[boneIndex];
+
+        glm::vec3 position = bone.positions[0].position;
+        if(bone.positions.size() > 1)
+        {
+            i32 index = LegacyFindKeyIndex(bone.positions, time, cursor.positionIndex);
+            f32 scaleFactor = GetScaleFactor(bone.positions[index].timeStamp, bone.positions[index + 1].timeStamp, time);
+            position = glm::mix(bone.positions[index].position, bone.positions[index + 1].position, scaleFactor);
+        }
+
+        glm::quat rotation = bone.rotations[0].orientation;
+        if(bone.rotations.size() > 1)
+        {
+            i32 index = LegacyFindKeyIndex(bone.rotations, time, cursor.rotationIndex);
+            f32 scaleFactor = GetScaleFactor(bone.rotations[index].timeStamp, bone.rotations[index + 1].timeStamp, time);
+            rotation = glm::slerp(bone.rotations[index].orientation, bone.rotations[index + 1].orientation, scaleFactor);
+        }
+
+        glm::vec3 scale = bone.scales[0].scale;
+        if(bone.scales.size() > 1)
+        {
+            i32 index = LegacyFindKeyIndex(bone.scales, time, cursor.scaleIndex);
+            f32 scaleFactor = GetScaleFactor(bone.scales[index].timeStamp, bone.scales[index + 1].timeStamp, time);
+            scale = glm::mix(bone.scales[index].scale, bone.scales[index + 1].scale, scaleFactor);
+        }
+
+        bone.localTransform = glm::translate(glm::mat4(1.0f), position) *
+                              glm::toMat4(glm::normalize(rotation)) *
+                              glm::scale(glm::mat4(1.0f), scale);
+    }
+}
+
+internal void AddCacheLine(std::vector<uintptr_t> &lines, const void *address)
+{
+    lines.push_back((uintptr_t)address / BENCHMARK_CACHE_LINE);
+}
+
+internal void AddTrackCacheLines(std::vector<uintptr_t> &lines, const AnimationKeys &keys, const AnimationTrack &track,
+                                 const void *values, size_t valueSize, i32 index)
+{
+    const u8 *first = (const u8 *)values + (track.keyOffset + index) * valueSize;
+    AddCacheLine(lines, &track);
+    AddCacheLine(lines, first);
+    AddCacheLine(lines, first + 2 * valueSize - 1);
+    if(TRACK_KIND_LINEAR_VARIABLE == track.kind)
+    {
+        AddCacheLine(lines, &keys.times[track.timeOffset + index]);
+        AddCacheLine(lines, &keys.times[track.timeOffset + index + 1]);
+    }
+    else if(TRACK_KIND_LINEAR_UNIFORM == track.kind)
+    {
+        AddCacheLine(lines, &keys.times[track.timeOffset]);
+    }
+}
+
+template <typename Key>
+void AddLegacyCacheLines(std::vector<uintptr_t> &lines, const std::vector<Key> &keys, i32 index)
+{
+    AddCacheLine(lines, &keys);
+    AddCacheLine(lines, &keys[index]);
+    AddCacheLine(lines, (const u8 *)&keys[index] + 2 * sizeof(Key) - 1);
+}
+
+internal size_t CountUniqueLines(std::vector<uintptr_t> &lines)
+{
+    std::sort(lines.begin(), lines.end());
+    return std::unique(lines.begin(), lines.end()) - lines.begin();
+}
+
+// cache lines read by the interpolation of a full pose at the given time,
+// the key search itself is not counted
+internal void CountPoseCacheLines(const Animation *animation, std::vector<LegacyBone> &bones, f32 time,
+                                  size_t *blockLines, size_t *legacyLines)
+{
+    const AnimationKeys &keys = animation->GetKeys();
+    std::vector<uintptr_t> lines;
+    std::vector<uintptr_t> linesLegacy;
+    for(i32 boneIndex = 0; boneIndex < animation->GetBoneCount(); ++boneIndex)
+    {
+        BoneCursor cursor = {};
+        f32 scaleFactor;
+        i32 positionIndex = 0;
+        i32 rotationIndex = 0;
+        i32 scaleIndex = 0;
+        const AnimationTrack &positionTrack = keys.positionTracks[boneIndex];
+        const AnimationTrack &rotationTrack = keys.rotationTracks[boneIndex];
+        const AnimationTrack &scaleTrack = keys.scaleTracks[boneIndex];
+        if(positionTrack.numKeys > 1)
+            positionIndex = GetTrackKeyIndex(keys, positionTrack, time, cursor.positionIndex, &scaleFactor);
+        if(rotationTrack.numKeys > 1)
+            rotationIndex = GetTrackKeyIndex(keys, rotationTrack, time, cursor.rotationIndex, &scaleFactor);
+        if(scaleTrack.numKeys > 1)
+            scaleIndex = GetTrackKeyIndex(keys, scaleTrack, time, cursor.scaleIndex, &scaleFactor);
+
+        AddTrackCacheLines(lines, keys, positionTrack, keys.positions.data(), sizeof(glm::vec3), positionIndex);
+        AddTrackCacheLines(lines, keys, rotationTrack, keys.rotations.data(), sizeof(glm::quat), rotationIndex);
+        AddTrackCacheLines(lines, keys, scaleTrack, keys.scales.data(), sizeof(glm::vec3), scaleIndex);
+
+        LegacyBone &bone = bones[boneIndex];
+        AddCacheLine(linesLegacy, &bone.localTransform);
+        AddLegacyCacheLines(linesLegacy, bone.positions, positionIndex);
+        AddLegacyCacheLines(linesLegacy, bone.rotations, rotationIndex);
+        AddLegacyCacheLines(linesLegacy, bone.scales, scaleIndex);
+    }
+
+    *blockLines = CountUniqueLines(lines);
+    *legacyLines = CountUniqueLines(linesLegacy);
+}
+
+internal void FlushCaches()
+{
+    local_persist std::vector<u8> flush(BENCHMARK_FLUSH_SIZE);
+    for(size_t index = 0; index < flush.size(); index += BENCHMARK_CACHE_LINE)
+    {
+        flush[index]++;
+    }
+}
+
+internal void BenchmarkKeyLayout(const Animation *animation)
+{
+    if(animation->IsBaked())
+    {
+        return;
+    }
+
+    std::vector<LegacyBone> bones;
+    BuildLegacyBones(animation, bones);
+
+    i32 boneCount = animation->GetBoneCount();
+    f32 duration = animation->GetDuration();
+    f32 step = animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+    std::vector<TimelineCursor> cursors(animation->GetTimelineCount(), TimelineCursor{});
+    std::vector<BoneCursor> legacyCursors(boneCount, BoneCursor{});
+    std::vector<BoneTransform> pose(boneCount);
+    animation->SampleConstantTracks(pose.data());
+
+    // every sample starts with the clip evicted from the caches, like the
+    // first character of a crowd that plays this clip in a frame
+    f64 coldMs = 0.0;
+    f64 coldLegacyMs = 0.0;
+    size_t lineCount = 0;
+    size_t legacyLineCount = 0;
+    f32 time = 0.0f;
+    for(i32 sample = 0; sample < BENCHMARK_COLD_SAMPLES; ++sample)
+    {
+        FlushCaches();
+        u64 start = SDL_GetPerformanceCounter();
+        animation->SamplePose(time, cursors.data(), pose.data());
+        u64 end = SDL_GetPerformanceCounter();
+        coldMs += GetMilliseconds(start, end);
+
+        FlushCaches();
+        start = SDL_GetPerformanceCounter();
+        SampleLegacyPose(bones, time, legacyCursors.data());
+        end = SDL_GetPerformanceCounter();
+        coldLegacyMs += GetMilliseconds(start, end);
+
+        size_t lines, legacyLines;
+        CountPoseCacheLines(animation, bones, time, &lines, &legacyLines);
+        lineCount += lines;
+        legacyLineCount += legacyLines;
+
+        time = fmodf(time + step, duration);
+    }
+
+    // the clip stays in cache, normal playback
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * duration / step);
+    time = 0.0f;
+    u64 start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        animation->SamplePose(time, cursors.data(), pose.data());
+        time = fmodf(time + step, duration);
+    }
+    u64 end = SDL_GetPerformanceCounter();
+    f64 warmMs = GetMilliseconds(start, end);
+
+    time = 0.0f;
+    start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        SampleLegacyPose(bones, time, legacyCursors.data());
+        time = fmodf(time + step, duration);
+    }
+    end = SDL_GetPerformanceCounter();
+    f64 warmLegacyMs = GetMilliseconds(start, end);
+
+    printf("Key layout (%d bones, full pose sample):\n", boneCount);
+    printf("  %-10s per bone %8.2f us/pose | blocks %8.2f us/pose\n", "cold",
+           coldLegacyMs * 1000.0 / BENCHMARK_COLD_SAMPLES, coldMs * 1000.0 / BENCHMARK_COLD_SAMPLES);
+    printf("  %-10s per bone %8.2f us/pose | blocks %8.2f us/pose\n", "warm",
+           warmLegacyMs * 1000.0 / frameCount, warmMs * 1000.0 / frameCount);
+    printf("  %-10s per bone %8.1f lines   | blocks %8.1f lines\n", "touched",
+           (f64)legacyLineCount / BENCHMARK_COLD_SAMPLES, (f64)lineCount / BENCHMARK_COLD_SAMPLES);
+}
+
+// largest angle nlerp drifts from slerp between two rotations that far apart
+internal f32 GetNlerpError(f32 angle)
+{
+    f32 halfAngle = 0.5f * angle;
+    f32 error = 0.0f;
+    for(i32 step = 0; step <= 64; ++step)
+    {
+        f32 t = step / 64.0f;
+        f32 nlerpAngle = atan2f(t * sinf(halfAngle), 1.0f - t + t * cosf(halfAngle));
+        error = fmaxf(error, 2.0f * fabsf(nlerpAngle - t * halfAngle));
+    }
+    return error;
+}
+
+// the batch sampler blends rotations with nlerp where the per bone path
+// slerps, so over one play of the clip the two may only differ by what
+// nlerp drifts on the widest rotation between two keys
+internal void CheckBatchedPose(const Animation *animation)
+{
+    i32 boneCount = animation->GetBoneCount();
+    const AnimationKeys &keys = animation->GetKeys();
+    f32 maxKeyAngle = 0.0f;
+    for(const AnimationTrack &track : keys.rotationTracks)
+    {
+        const glm::quat *rotations = &keys.rotations[track.keyOffset];
+        for(i32 keyIndex = 0; keyIndex < track.numKeys - 1; ++keyIndex)
+        {
+            maxKeyAngle = fmaxf(maxKeyAngle, GetRotationError(rotations[keyIndex], rotations[keyIndex + 1]));
+        }
+    }
+
+    f32 duration = animation->GetDuration();
+    f32 step = animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+    std::vector<BoneCursor> boneCursors(boneCount, BoneCursor{});
+    std::vector<TimelineCursor> cursors(animation->GetTimelineCount(), TimelineCursor{});
+    std::vector<BoneTransform> pose(boneCount);
+    animation->SampleConstantTracks(pose.data());
+    f32 positionDifference = 0.0f;
+    f32 rotationDifference = 0.0f;
+    for(f32 time = 0.0f; time < duration; time += step)
+    {
+        animation->SamplePose(time, cursors.data(), pose.data());
+        for(i32 boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+        {
+            BoneTransform expected = SampleBoneTransform(keys, boneIndex, time, boneCursors[boneIndex]);
+            f32 positionScale = 1.0f + glm::length(expected.translation);
+            positionDifference = fmaxf(positionDifference, glm::length(pose[boneIndex].translation - expected.translation) / positionScale);
+            rotationDifference = fmaxf(rotationDifference, GetRotationError(pose[boneIndex].rotation, expected.rotation));
+        }
+    }
+
+    f32 rotationBound = GetNlerpError(maxKeyAngle) + 0.001f;
+    printf("  %-10s position %f, rotation %f deg, nlerp bound %f deg\n", "difference", positionDifference,
+           glm::degrees(rotationDifference), glm::degrees(rotationBound));
+    Assert(positionDifference < 0.0001f);
+    Assert(rotationDifference <= rotationBound);
+}
+
+// full pose sample one bone at a time against the batch sampler
+internal void BenchmarkPoseSampling(const Animation *animation)
+{
+    i32 boneCount = animation->GetBoneCount();
+    const AnimationKeys &keys = animation->GetKeys();
+    f32 duration = animation->GetDuration();
+    f32 step = animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * duration / step);
+
+    std::vector<BoneCursor> boneCursors(boneCount, BoneCursor{});
+    std::vector<TimelineCursor> cursors(animation->GetTimelineCount(), TimelineCursor{});
+    std::vector<BoneTransform> pose(boneCount);
+    animation->SampleConstantTracks(pose.data());
+    f32 checksum = 0.0f;
+
+    f32 time = 0.0f;
+    u64 start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        for(i32 boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+        {
+            pose[boneIndex] = SampleBoneTransform(keys, boneIndex, time, boneCursors[boneIndex]);
+        }
+        checksum += pose[0].rotation.w;
+        time = fmodf(time + step, duration);
+    }
+    u64 end = SDL_GetPerformanceCounter();
+    f64 scalarMs = GetMilliseconds(start, end);
+
+    time = 0.0f;
+    start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        animation->SamplePose(time, cursors.data(), pose.data());
+        checksum += pose[0].rotation.w;
+        time = fmodf(time + step, duration);
+    }
+    end = SDL_GetPerformanceCounter();
+    f64 batchMs = GetMilliseconds(start, end);
+
+    f64 bones = (f64)frameCount * (boneCount > 0 ? boneCount : 1);
+    printf("Pose sampling (%d lanes, checksum %f):\n", GetSamplerLanes(), checksum);
+    printf("  %-10s per bone %8.2f ns/bone | batched %8.2f ns/bone | %6.2fx\n", "sample",
+           scalarMs * 1000000.0 / bones, batchMs * 1000000.0 / bones,
+           batchMs > 0.0 ? scalarMs / batchMs : 0.0);
+    CheckBatchedPose(animation);
+}
+
+// ns per bone of playing a clip through SamplePose at the frame rate
+internal f64 TimePoseSampling(const Animation &animation, f32 *checksum)
+{
+    i32 boneCount = animation.GetBoneCount();
+    f32 duration = animation.GetDuration();
+    f32 step = animation.GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * duration / step);
+
+    std::vector<TimelineCursor> cursors(animation.GetTimelineCount(), TimelineCursor{});
+    std::vector<BoneTransform> pose(boneCount);
+    animation.SampleConstantTracks(pose.data());
+    *checksum = 0.0f;
+
+    f32 time = 0.0f;
+    u64 start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        animation.SamplePose(time, cursors.data(), pose.data());
+        // quantized rotations may come back in the other hemisphere
+        *checksum += fabsf(pose[0].rotation.w);
+        time = fmodf(time + step, duration);
+    }
+    u64 end = SDL_GetPerformanceCounter();
+
+    f64 bones = (f64)frameCount * (boneCount > 0 ? boneCount : 1);
+    return GetMilliseconds(start, end) * 1000000.0 / bones;
+}
+
+// what the import passes did to the clip, the passes that did not run are
+// left out
+internal void PrintTrackStats(const Animation &animation)
+{
+    const TrackStats &stats = animation.GetTrackStats();
+    i32 trackCount = animation.GetBoneCount();
+    printf("    folded    %d of %d bones static, constant tracks (identity) positions %d (%d), rotations %d (%d), scales %d (%d)\n",
+           stats.staticBones, trackCount,
+           stats.positions[TRACK_CONSTANT] + stats.positions[TRACK_IDENTITY], stats.positions[TRACK_IDENTITY],
+           stats.rotations[TRACK_CONSTANT] + stats.rotations[TRACK_IDENTITY], stats.rotations[TRACK_IDENTITY],
+           stats.scales[TRACK_CONSTANT] + stats.scales[TRACK_IDENTITY], stats.scales[TRACK_IDENTITY]);
+    if(stats.sourceKeys > 0)
+    {
+        printf("    reduced   keys %d -> %d, %.1f%% removed\n", stats.sourceKeys, stats.reducedKeys,
+               100.0f * (stats.sourceKeys - stats.reducedKeys) / stats.sourceKeys);
+    }
+    if(stats.bakedSamples > 0)
+    {
+        printf("    baked     %d samples per animated track, max position error %f, max rotation error %f deg\n",
+               stats.bakedSamples, stats.bakePositionError, glm::degrees(stats.bakeRotationError));
+    }
+    printf("    kinds     %d constant, %d uniform, %d variable, %d stepped, %d cubic tracks\n",
+           stats.kinds[TRACK_KIND_CONSTANT], stats.kinds[TRACK_KIND_LINEAR_UNIFORM],
+           stats.kinds[TRACK_KIND_LINEAR_VARIABLE], stats.kinds[TRACK_KIND_STEPPED], stats.kinds[TRACK_KIND_CUBIC]);
+    printf("    shared    %d tracks on %d timelines, %d searched per sample, times %d -> %d\n", trackCount * 3,
+           stats.timelines, stats.searchedTimelines, stats.sourceTimes, stats.sharedTimes);
+    if(animation.IsQuantized())
+    {
+        printf("    quantized %.1f KB -> %.1f KB, max position error %f, max rotation error %f deg, max scale error %f\n",
+               stats.floatKeyBytes / 1024.0, animation.GetKeyBytes() / 1024.0, stats.quantizePositionError,
+               glm::degrees(stats.quantizeRotationError), stats.quantizeScaleError);
+    }
+}
+
+// key memory and pose sampling cost of the float and quantized key formats
+internal void BenchmarkKeyCompression(const char *path, Model *model, SceneCache *scenes)
+{
+    const char *names[] = { "float", "48 bit", "32 bit" };
+    KeyCompression compressions[] = { KEY_COMPRESSION_NONE, KEY_COMPRESSION_48, KEY_COMPRESSION_32 };
+
+    printf("Key compression:\n");
+    for(i32 formatIndex = 0; formatIndex < (i32)ArrayCount(compressions); ++formatIndex)
+    {
+        AnimationImportSettings settings = {};
+        settings.compression = compressions[formatIndex];
+        settings.ignoreCooked = true;
+        AnimationLibrary library(path, model, settings, scenes);
+        const Animation &animation = *library.GetClip(0);
+        f32 checksum;
+        f64 nsPerBone = TimePoseSampling(animation, &checksum);
+        printf("  %-10s %8.1f KB | %8.2f ns/bone | checksum %f\n", names[formatIndex],
+               animation.GetKeyBytes() / 1024.0, nsPerBone, checksum);
+        PrintTrackStats(animation);
+    }
+}
+
+// key memory and pose sampling cost after key reduction at a few tolerances,
+// with linear segments and with fitted cubic curves
+internal void BenchmarkKeyReduction(const char *path, Model *model, SceneCache *scenes)
+{
+    f32 positionTolerances[] = { 0.0f, 0.001f, 0.01f, 0.1f };
+
+    printf("Key reduction (rotation tolerance 0.5 deg):\n");
+    for(i32 toleranceIndex = 0; toleranceIndex < (i32)ArrayCount(positionTolerances); ++toleranceIndex)
+    {
+        for(i32 fitCurves = 0; fitCurves < 2; ++fitCurves)
+        {
+            if(0 == toleranceIndex && fitCurves) continue;
+            AnimationImportSettings settings = {};
+            settings.positionTolerance = positionTolerances[toleranceIndex];
+            settings.rotationTolerance = toleranceIndex > 0 ? glm::radians(0.5f) : 0.0f;
+            settings.fitCurves = fitCurves != 0;
+            settings.ignoreCooked = true;
+            AnimationLibrary library(path, model, settings, scenes);
+            const Animation &animation = *library.GetClip(0);
+            f32 checksum;
+            f64 nsPerBone = TimePoseSampling(animation, &checksum);
+            printf("  %-10.3f %-6s %8.1f KB | %8.2f ns/bone | checksum %f\n", positionTolerances[toleranceIndex],
+                   fitCurves ? "cubic" : "linear", animation.GetKeyBytes() / 1024.0, nsPerBone, checksum);
+            PrintTrackStats(animation);
+        }
+    }
+}
+
+// key memory, pose sampling cost and error of the clip baked at a few rates,
+// against the source keys
+internal void BenchmarkBakeRates(const char *path, Model *model, SceneCache *scenes)
+{
+    f32 bakeRates[] = { 0.0f, 15.0f, 30.0f, 60.0f };
+
+    printf("Bake rates:\n");
+    for(i32 rateIndex = 0; rateIndex < (i32)ArrayCount(bakeRates); ++rateIndex)
+    {
+        AnimationImportSettings settings = {};
+        settings.bakeRate = bakeRates[rateIndex];
+        settings.ignoreCooked = true;
+        AnimationLibrary library(path, model, settings, scenes);
+        const Animation &animation = *library.GetClip(0);
+        f32 checksum;
+        f64 nsPerBone = TimePoseSampling(animation, &checksum);
+        const TrackStats &stats = animation.GetTrackStats();
+        char name[32];
+        if(settings.bakeRate > 0.0f) snprintf(name, sizeof(name), "%.0f Hz", settings.bakeRate);
+        else snprintf(name, sizeof(name), "source");
+        printf("  %-10s %8.1f KB | %8.2f ns/bone | max error %f, %f deg\n", name, animation.GetKeyBytes() / 1024.0,
+               nsPerBone, stats.bakePositionError, glm::degrees(stats.bakeRotationError));
+    }
+}
+
+// pose sampling with every track searched by time stamp against the tracks
+// sorted into kinds, each kind batch running its own sampler
+internal void BenchmarkTrackKinds(const char *path, Model *model, SceneCache *scenes)
+{
+    printf("Track kinds:\n");
+    for(i32 keepKeyTimes = 1; keepKeyTimes >= 0; --keepKeyTimes)
+    {
+        AnimationImportSettings settings = {};
+        settings.keepKeyTimes = keepKeyTimes != 0;
+        settings.ignoreCooked = true;
+        AnimationLibrary library(path, model, settings, scenes);
+        const Animation &animation = *library.GetClip(0);
+        f32 checksum;
+        f64 nsPerBone = TimePoseSampling(animation, &checksum);
+        printf("  %-10s %8.1f KB | %8.2f ns/bone | checksum %f\n", keepKeyTimes ? "variable" : "by kind",
+               animation.GetKeyBytes() / 1024.0, nsPerBone, checksum);
+        PrintTrackStats(animation);
+    }
+}
+
+// local transform to model space for every bone, with the three matrix build
+// the bones used before and with the fused affine path
+internal void BenchmarkLocalTransforms(const Animation *animation)
+{
+    i32 boneCount = animation->GetBoneCount();
+    if(boneCount == 0) return;
+
+    f32 duration = animation->GetDuration();
+    f32 step = animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME;
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * duration / step);
+
+    std::vector<TimelineCursor> cursors(animation->GetTimelineCount(), TimelineCursor{});
+    std::vector<BoneTransform> pose(boneCount);
+    animation->SampleConstantTracks(pose.data());
+    std::vector<glm::mat4> modelPose(boneCount, glm::mat4(1.0f));
+    animation->SamplePose(duration * 0.5f, cursors.data(), pose.data());
+
+    f32 checksum = 0.0f;
+    u64 start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        glm::mat4 parent = glm::mat4(1.0f);
+        for(i32 boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+        {
+            const BoneTransform &transform = pose[boneIndex];
+            glm::mat4 translation = glm::translate(glm::mat4(1.0f), transform.translation);
+            glm::mat4 rotation = glm::toMat4(transform.rotation);
+            glm::mat4 scale = glm::scale(glm::mat4(1.0f), transform.scale);
+            modelPose[boneIndex] = parent * (translation * rotation * scale);
+            parent = modelPose[boneIndex];
+        }
+        checksum += modelPose[boneCount - 1][3][0];
+    }
+    u64 end = SDL_GetPerformanceCounter();
+    f64 matrixMs = GetMilliseconds(start, end);
+
+    start = SDL_GetPerformanceCounter();
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        glm::mat4 parent = glm::mat4(1.0f);
+        for(i32 boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+        {
+            modelPose[boneIndex] = MultiplyAffine(parent, ComposeAffine(pose[boneIndex]));
+            parent = modelPose[boneIndex];
+        }
+        checksum += modelPose[boneCount - 1][3][0];
+    }
+    end = SDL_GetPerformanceCounter();
+    f64 affineMs = GetMilliseconds(start, end);
+
+    f64 bones = (f64)frameCount * boneCount;
+    printf("Local transform (%d bones, checksum %f):\n", boneCount, checksum);
+    printf("  %-10s three mat4 %8.2f ns/bone | fused affine %8.2f ns/bone | %6.2fx\n", "compose",
+           matrixMs * 1000000.0 / bones, affineMs * 1000000.0 / bones,
+           affineMs > 0.0 ? matrixMs / affineMs : 0.0);
+}
+
+internal void BenchmarkAnimatorAllocations(const Animation *animation)
+{
+    Animator animator(animation);
+    for(i32 frame = 0; frame < 4; ++frame)
+    {
+        animator.UpdateAnimation(TARGET_SECONDS_PER_FRAME);
+    }
+
+    i32 frameCount = (i32)(BENCHMARK_LOOPS * animation->GetDuration() / (animation->GetTicksPerSecond() * TARGET_SECONDS_PER_FRAME));
+    u64 allocatedBytes = gAllocatedBytes;
+    u64 allocationCount = gAllocationCount;
+    for(i32 frame = 0; frame < frameCount; ++frame)
+    {
+        animator.UpdateAnimation(TARGET_SECONDS_PER_FRAME);
+    }
+    allocatedBytes = gAllocatedBytes - allocatedBytes;
+    allocationCount = gAllocationCount - allocationCount;
+
+    printf("Animator update (%d frames): %llu allocations, %llu bytes\n", frameCount,
+           (unsigned long long)allocationCount, (unsigned long long)allocatedBytes);
+    Assert(allocatedBytes == 0);
+}
+
+// a model and the clips of its file with an import each, with one import
+// shared through the scene cache and loaded from their cooked files
+internal void BenchmarkSceneImport(const char *path)
+{
+    AnimationImportSettings importSettings = {};
+    importSettings.ignoreCooked = true;
+
+    u64 start = SDL_GetPerformanceCounter();
+    {
+        SceneCache modelScenes = {};
+        Model model(path, &modelScenes, false, true);
+        ReleaseScenes(&modelScenes);
+        AnimationLibrary library(path, &model, importSettings);
+    }
+    u64 separate = SDL_GetPerformanceCounter();
+    {
+        SceneCache scenes = {};
+        Model model(path, &scenes, false, true);
+        AnimationLibrary library(path, &model, importSettings, &scenes);
+        ReleaseScenes(&scenes);
+    }
+    u64 shared = SDL_GetPerformanceCounter();
+
+    // the first pass cooks the files if they are not yet
+    f64 meshMilliseconds[2];
+    f64 clipMilliseconds[2];
+    i32 clipCount = 0;
+    for(i32 pass = 0; pass < 2; ++pass)
+    {
+        u64 meshStart = SDL_GetPerformanceCounter();
+        Model model(path);
+        u64 clipStart = SDL_GetPerformanceCounter();
+        AnimationLibrary library(path, &model);
+        u64 clipEnd = SDL_GetPerformanceCounter();
+        meshMilliseconds[pass] = GetMilliseconds(meshStart, clipStart);
+        clipMilliseconds[pass] = GetMilliseconds(clipStart, clipEnd);
+        clipCount = library.GetClipCount();
+    }
+
+    printf("Scene import: separate %.2f ms | shared %.2f ms\n",
+           GetMilliseconds(start, separate), GetMilliseconds(separate, shared));
+    printf("Mesh load: first %.3f ms | cooked %.3f ms\n", meshMilliseconds[0], meshMilliseconds[1]);
+    printf("Clip load (%d clips): first %.3f ms | cooked %.3f ms\n", clipCount, clipMilliseconds[0], clipMilliseconds[1]);
+}
+
+// a grid with a vertex per triangle corner and the triangles shuffled, the
+// worst case an exporter hands over, through the import optimization
+internal void BenchmarkMeshOptimization()
+{
+    const i32 gridSize = 256;
+    std::vector<i32> quads(gridSize * gridSize);
+    for(i32 i = 0; i < (i32)quads.size(); ++i) quads[i] = i;
+    srand(1234);
+    for(i32 i = (i32)quads.size() - 1; i > 0; --i) std::swap(quads[i], quads[rand() % (i + 1)]);
+
+    std::vector<Vertex> vertices;
+    std::vector<u32> indices;
+    for(i32 quad : quads)
+    {
+        i32 x = quad % gridSize;
+        i32 y = quad / gridSize;
+        i32 corners[6][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1} };
+        for(i32 corner = 0; corner < 6; ++corner)
+        {
+            Vertex vertex = {};
+            vertex.position = glm::vec3((f32)(x + corners[corner][0]), 0.0f, (f32)(y + corners[corner][1]));
+            vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            indices.push_back((u32)vertices.size());
+            vertices.push_back(vertex);
+        }
+    }
+
+    u64 start = SDL_GetPerformanceCounter();
+    MeshOptimizeStats stats = OptimizeMesh(vertices, indices);
+    u64 end = SDL_GetPerformanceCounter();
+    Assert(stats.vertices == (gridSize + 1) * (gridSize + 1));
+    Assert((i32)indices.size() == stats.triangles * 3);
+
+    printf("Mesh optimization (%d triangles): %.2f ms, vertices %d -> %d, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, "
+           "%d overdraw clusters\n", stats.triangles, GetMilliseconds(start, end), stats.sourceVertices, stats.vertices,
+           GetACMR(stats.sourceMisses, stats.triangles), GetACMR(stats.misses, stats.triangles),
+           GetATVR(stats.sourceMisses, stats.sourceVertices), GetATVR(stats.misses, stats.vertices), stats.clusters);
+}
+
+// samples a variable and a uniform track before their first and past their
+// last key, both must hold the end keys instead of extrapolating
+internal void CheckEndKeys()
+{
+    AnimationKeys keys = {};
+    glm::vec3 values[] = { glm::vec3(1.0f), glm::vec3(2.0f), glm::vec3(4.0f) };
+    AddTrack(keys, keys.positionTracks, 0, 3);
+    for(i32 keyIndex = 0; keyIndex < 3; ++keyIndex)
+    {
+        keys.times.push_back(1.0f + keyIndex);
+        keys.positions.push_back(values[keyIndex]);
+    }
+    AddUniformTrack(keys, keys.positionTracks, 3, 3, 1.0f, 1.0f);
+    keys.positions.insert(keys.positions.end(), values, values + 3);
+
+    for(i32 trackIndex = 0; trackIndex < 2; ++trackIndex)
+    {
+        i32 cursor = 0;
+        Assert(SamplePosition(keys, trackIndex, 0.0f, cursor) == values[0]);
+        Assert(SamplePosition(keys, trackIndex, 5.0f, cursor) == values[2]);
+        Assert(SamplePosition(keys, trackIndex, 0.0f, cursor) == values[0]);
+    }
+    printf("End keys: held before the first and past the last key\n");
+}
+
+internal void RunAnimationBenchmarks(const char *path)
+{
+    printf("Benchmarking %s\n", path);
+    CheckEndKeys();
+    BenchmarkSceneImport(path);
+
+    // every clip below is built from the one import of the file
+    SceneCache scenes = {};
+    Model model(path, &scenes);
+    AnimationImportSettings settings = {};
+    settings.ignoreCooked = true;
+    AnimationLibrary library(path, &model, settings, &scenes);
+    const Animation *animation = library.GetClip(0);
+
+    // the search benchmarks need a time stamp per key
+    AnimationImportSettings variableSettings = settings;
+    variableSettings.keepKeyTimes = true;
+    AnimationLibrary variableLibrary(path, &model, variableSettings, &scenes);
+    const Animation *variableAnimation = variableLibrary.GetClip(0);
+
+    BenchmarkKeyCursors(variableAnimation);
+    BenchmarkKeyLayout(variableAnimation);
+    BenchmarkPoseSampling(animation);
+    BenchmarkTrackKinds(path, &model, &scenes);
+    BenchmarkKeyCompression(path, &model, &scenes);
+    BenchmarkKeyReduction(path, &model, &scenes);
+    BenchmarkBakeRates(path, &model, &scenes);
+    BenchmarkLocalTransforms(animation);
+    BenchmarkAnimatorAllocations(animation);
+    BenchmarkMeshOptimization();
+    ReleaseScenes(&scenes);
+}
@@ -1,186 +1,1254 @@
-struct KeyPosition
+// max number of keys a cursor walks before falling back to a search
+#define KEY_CURSOR_MAX_STEPS 4
+// average number of keys in a bucket of the time index of a track
+#define KEY_BUCKET_KEYS 4
+
+// per instance playback state of a bone, each index is the key that
+// bracketed the last sample of that track
+struct BoneCursor
 {
-    glm::vec3 position;
-    f32 timeStamp; 
+    i32 positionIndex;
+    i32 rotationIndex;
+    i32 scaleIndex;
 };
 
-struct KeyRotation
+// per instance playback state of a timeline, the pose sampler searches every
+// timeline once and all tracks on it read the segment from here
+struct TimelineCursor
 {
-    glm::quat orientation;
-    f32 timeStamp;
+    i32 searchIndex; // segment the last search ended in, the next one walks from there
+    i32 keyIndex;    // first key of the segment of the current sample
+    f32 scaleFactor; // how far into that segment the current sample is
 };
 
-struct KeyScale
+// sampled local transform of a bone, kept as translation, rotation and scale
+// until it has to become a matrix
+struct BoneTransform
 {
+    glm::vec3 translation;
+    glm::quat rotation;
     glm::vec3 scale;
-    f32 timeStamp;
 };
 
-class Bone
+// how the keys of a track are laid out in time and interpolated, every kind
+// has its own sampler so a batch of tracks of one kind runs without branches
+enum TrackKind
+{
+    TRACK_KIND_CONSTANT,        // a single key
+    TRACK_KIND_LINEAR_UNIFORM,  // keys at a fixed rate, the times are the first key time and the keys per tick
+    TRACK_KIND_LINEAR_VARIABLE, // a time stamp per key
+    TRACK_KIND_STEPPED,         // a time stamp per key, every key holds until the next one
+    TRACK_KIND_CUBIC,           // a time stamp per key, a Catmull-Rom curve runs through the keys
+    TRACK_KIND_COUNT
+};
+
+// a track is a run of keys inside the key blocks of a clip
+struct AnimationTrack
+{
+    i32 timeOffset; // first entry of the track in AnimationKeys::times
+    i32 keyOffset;  // first value in the positions, rotations or scales block
+    i32 numKeys;
+    TrackKind kind;
+    i32 bucketOffset;   // first entry of the time index in AnimationKeys::buckets
+    i32 numBuckets;     // 0 for tracks without a time index
+    f32 bucketsPerTick;
+    i32 timeline;       // entry in AnimationKeys::timelines, -1 until the timelines are shared
+};
+
+// animated tracks of one component grouped by kind
+struct TrackBatches
+{
+    std::vector<i32> tracks[TRACK_KIND_COUNT];
+};
+
+// key data of every bone of a clip in a few contiguous blocks, track i of
+// each table belongs to bone i. Sampling a full pose walks the tables in
+// order so the key blocks are read front to back
+struct AnimationKeys
+{
+    std::vector<f32> times;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+
+    std::vector<AnimationTrack> positionTracks;
+    std::vector<AnimationTrack> rotationTracks;
+    std::vector<AnimationTrack> scaleTracks;
+
+    // time index of the tracks with a time stamp per key, bucket i of a track
+    // holds the segment that contains the start time of the bucket
+    std::vector<i32> buckets;
+
+    // every distinct run of key times, a timeline is a track without values
+    // and all tracks with the same kind and times point at one
+    std::vector<AnimationTrack> timelines;
+    TrackBatches timelineBatches;
+
+    // > 0 for baked clips, every animated track is then sampled at this rate
+    f32 samplesPerTick;
+
+    // the tracks sampled every frame, constant ones are never in a batch
+    TrackBatches positionBatches;
+    TrackBatches rotationBatches;
+    TrackBatches scaleBatches;
+};
+
+inline i32 FindKeyIndexLinear(const f32 *times, i32 numKeys, f32 animationTime)
 {
-public:
-    Bone(const std::string &name, i32 ID, const aiNodeAnim *channel)
-        : mName(name), mID(ID), mLocalTransform(1.0f)
+    for(i32 index = 0; index < numKeys - 1; ++index)
     {
-        mNumPositions = channel->mNumPositionKeys;
-        for(i32 positionIndex = 0; positionIndex < mNumPositions; ++positionIndex)
+        if(animationTime < times[index + 1])
         {
-            aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
-            f32 timeStamp = (f32)channel->mPositionKeys[positionIndex].mTime;
-            KeyPosition data;
-            data.position = GetGLMVec(aiPosition);
-            data.timeStamp = timeStamp;
-            mPositions.push_back(data);
+            return index;
         }
+    }
+    // past the last key, hold the last segment
+    return numKeys - 2;
+}
+
+inline i32 FindKeyIndexBinary(const f32 *times, i32 numKeys, f32 animationTime)
+{
+    // first key in [1, numKeys - 1] with time > animationTime
+    i32 low = 1;
+    i32 high = numKeys - 1;
+    while(low < high)
+    {
+        i32 middle = low + (high - low) / 2;
+        if(animationTime < times[middle])
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return low - 1;
+}
+
+inline i32 GetKeyBucket(f32 firstTime, i32 numBuckets, f32 bucketsPerTick, f32 animationTime)
+{
+    i32 bucket = (i32)((animationTime - firstTime) * bucketsPerTick);
+    if(bucket > numBuckets - 1) bucket = numBuckets - 1;
+    if(bucket < 0) bucket = 0;
+    return bucket;
+}
+
+// the bucket of animationTime gives a segment at or before the one it lies
+// in, the scan from there only passes the keys inside the bucket
+inline i32 FindKeyIndexBucketed(const f32 *times, i32 numKeys, const i32 *buckets, i32 numBuckets,
+                                f32 bucketsPerTick, f32 animationTime)
+{
+    i32 bucket = GetKeyBucket(times[0], numBuckets, bucketsPerTick, animationTime);
+    i32 lastIndex = numKeys - 2;
+    i32 index = buckets[bucket];
+    while(index < lastIndex && animationTime >= times[index + 1])
+    {
+        ++index;
+    }
+    return index;
+}
+
+// key lookup without any playback state, random access like scrubbing or
+// rewinding goes through the time index when the track has one
+inline i32 FindTrackKeyIndex(const AnimationKeys &keys, const AnimationTrack &track, f32 animationTime)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    if(track.numBuckets > 0)
+    {
+        return FindKeyIndexBucketed(times, track.numKeys, &keys.buckets[track.bucketOffset], track.numBuckets,
+                                    track.bucketsPerTick, animationTime);
+    }
+    return FindKeyIndexBinary(times, track.numKeys, animationTime);
+}
+
+// walks from the segment of the last sample, search() finds the segment when
+// the cursor is invalid or too far away
+template<typename Search>
+inline i32 FindKeyIndex(const f32 *times, i32 numKeys, f32 animationTime, i32 &cursor, Search search)
+{
+    i32 lastIndex = numKeys - 2;
+    i32 index = cursor;
+    if(index < 0 || index > lastIndex)
+    {
+        index = search();
+        cursor = index;
+        return index;
+    }
 
-        mNumRotations = channel->mNumPositionKeys;
-        for(i32 rotationIndex = 0; rotationIndex < mNumRotations; ++rotationIndex)
+    if(animationTime >= times[index + 1])
+    {
+        // playing forward, step until the next key is past the sample time
+        i32 steps = 0;
+        while(index < lastIndex && animationTime >= times[index + 1])
+        {
+            if(++steps > KEY_CURSOR_MAX_STEPS)
+            {
+                index = search();
+                break;
+            }
+            ++index;
+        }
+    }
+    else if(index > 0 && animationTime < times[index])
+    {
+        // playing backward or the clip looped
+        i32 steps = 0;
+        while(index > 0 && animationTime < times[index])
         {
-            aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
-            f32 timeStamp = (f32)channel->mRotationKeys[rotationIndex].mTime;
-            KeyRotation data;
-            data.orientation = GetGLMQuat(aiOrientation);
-            data.timeStamp = timeStamp;
-            mRotations.push_back(data);
+            if(++steps > KEY_CURSOR_MAX_STEPS)
+            {
+                index = search();
+                break;
+            }
+            --index;
         }
+    }
 
-        mNumScalings = channel->mNumScalingKeys;
-        for(i32 scaleIndex = 0; scaleIndex < mNumScalings; ++scaleIndex)
+    cursor = index;
+    return index;
+}
+
+inline i32 FindKeyIndex(const f32 *times, i32 numKeys, f32 animationTime, i32 &cursor)
+{
+    return FindKeyIndex(times, numKeys, animationTime, cursor, [&]()
+    {
+        return FindKeyIndexBinary(times, numKeys, animationTime);
+    });
+}
+
+// cursor lookup that falls back to the time index of the track
+inline i32 FindTrackKeyIndex(const AnimationKeys &keys, const AnimationTrack &track, f32 animationTime, i32 &cursor)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    return FindKeyIndex(times, track.numKeys, animationTime, cursor, [&]()
+    {
+        return FindTrackKeyIndex(keys, track, animationTime);
+    });
+}
+
+// clamped, so before the first and past the last key the end keys hold
+inline f32 GetScaleFactor(f32 lastTimeStamp, f32 nextTimeStamp, f32 animationTime)
+{
+    f32 scaleFactor = 0.0f;
+    f32 midWayLength = animationTime - lastTimeStamp;
+    f32 framesDiff = nextTimeStamp - lastTimeStamp;
+    scaleFactor = midWayLength / framesDiff;
+    if(scaleFactor < 0.0f) scaleFactor = 0.0f;
+    if(scaleFactor > 1.0f) scaleFactor = 1.0f;
+    return scaleFactor;
+}
+
+// last key at or before animationTime, the first key before the track starts
+inline i32 FindHeldKeyIndex(const AnimationKeys &keys, const AnimationTrack &track, f32 animationTime, i32 &cursor)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    i32 index = FindTrackKeyIndex(keys, track, animationTime, cursor);
+    if(animationTime >= times[index + 1]) ++index;
+    return index;
+}
+
+// first key of the segment that contains animationTime and how far into the
+// segment it is, specialized per kind of track
+template<TrackKind Kind>
+inline i32 GetKindKeyIndex(const AnimationKeys &keys, const AnimationTrack &track,
+                           f32 animationTime, i32 &cursor, f32 *scaleFactor);
+
+template<>
+inline i32 GetKindKeyIndex<TRACK_KIND_LINEAR_UNIFORM>(const AnimationKeys &keys, const AnimationTrack &track,
+                                                      f32 animationTime, i32 &cursor, f32 *scaleFactor)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    f32 sample = (animationTime - times[0]) * times[1];
+    i32 index = (i32)sample;
+    if(index > track.numKeys - 2) index = track.numKeys - 2;
+    if(index < 0) index = 0;
+    f32 factor = sample - (f32)index;
+    if(factor < 0.0f) factor = 0.0f;
+    if(factor > 1.0f) factor = 1.0f;
+    *scaleFactor = factor;
+    return index;
+}
+
+template<>
+inline i32 GetKindKeyIndex<TRACK_KIND_LINEAR_VARIABLE>(const AnimationKeys &keys, const AnimationTrack &track,
+                                                       f32 animationTime, i32 &cursor, f32 *scaleFactor)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    i32 index = FindTrackKeyIndex(keys, track, animationTime, cursor);
+    *scaleFactor = GetScaleFactor(times[index], times[index + 1], animationTime);
+    return index;
+}
+
+// the segment is found like a linear one, the neighbouring keys only shape
+// the curve inside it
+template<>
+inline i32 GetKindKeyIndex<TRACK_KIND_CUBIC>(const AnimationKeys &keys, const AnimationTrack &track,
+                                             f32 animationTime, i32 &cursor, f32 *scaleFactor)
+{
+    return GetKindKeyIndex<TRACK_KIND_LINEAR_VARIABLE>(keys, track, animationTime, cursor, scaleFactor);
+}
+
+// the held key is the start of the segment, or its end past the last key,
+// so the factor is always 0 or 1
+template<>
+inline i32 GetKindKeyIndex<TRACK_KIND_STEPPED>(const AnimationKeys &keys, const AnimationTrack &track,
+                                               f32 animationTime, i32 &cursor, f32 *scaleFactor)
+{
+    i32 index = FindHeldKeyIndex(keys, track, animationTime, cursor);
+    if(index == track.numKeys - 1)
+    {
+        *scaleFactor = 1.0f;
+        return index - 1;
+    }
+    *scaleFactor = 0.0f;
+    return index;
+}
+
+// returns the first key of the segment that contains animationTime, for the
+// paths that sample one track at a time
+inline i32 GetTrackKeyIndex(const AnimationKeys &keys, const AnimationTrack &track,
+                            f32 animationTime, i32 &cursor, f32 *scaleFactor)
+{
+    switch(track.kind)
+    {
+        case TRACK_KIND_LINEAR_UNIFORM:
+            return GetKindKeyIndex<TRACK_KIND_LINEAR_UNIFORM>(keys, track, animationTime, cursor, scaleFactor);
+        case TRACK_KIND_STEPPED:
+            return GetKindKeyIndex<TRACK_KIND_STEPPED>(keys, track, animationTime, cursor, scaleFactor);
+        default:
+            return GetKindKeyIndex<TRACK_KIND_LINEAR_VARIABLE>(keys, track, animationTime, cursor, scaleFactor);
+    }
+}
+
+// weights that turn the difference of the neighbours of a segment into the
+// tangent at its first and second key, already scaled to the length of the
+// segment. The keys before the first and after the last repeat the end key
+inline void GetCubicWeights(f32 previousTime, f32 firstTime, f32 secondTime, f32 nextTime,
+                            f32 *firstWeight, f32 *secondWeight)
+{
+    f32 segmentLength = secondTime - firstTime;
+    *firstWeight = segmentLength / (secondTime - previousTime);
+    *secondWeight = segmentLength / (nextTime - firstTime);
+}
+
+// keys on either side of the segment that starts at keyIndex
+inline void GetCubicNeighbours(const AnimationKeys &keys, const AnimationTrack &track, i32 keyIndex,
+                               i32 *previous, i32 *next, f32 *firstWeight, f32 *secondWeight)
+{
+    const f32 *times = &keys.times[track.timeOffset];
+    *previous = keyIndex > 0 ? keyIndex - 1 : keyIndex;
+    *next = keyIndex + 2 < track.numKeys ? keyIndex + 2 : keyIndex + 1;
+    GetCubicWeights(times[*previous], times[keyIndex], times[keyIndex + 1], times[*next], firstWeight, secondWeight);
+}
+
+// Hermite curve between first and second, with the tangents taken from the
+// neighbours of the segment
+template<typename Value>
+inline Value HermiteCurve(const Value &previous, const Value &first, const Value &second, const Value &next,
+                          f32 t, f32 firstWeight, f32 secondWeight)
+{
+    f32 t2 = t * t;
+    f32 t3 = t2 * t;
+    Value firstTangent = (second - previous) * firstWeight;
+    Value secondTangent = (next - first) * secondWeight;
+    return first * (2.0f * t3 - 3.0f * t2 + 1.0f) + firstTangent * (t3 - 2.0f * t2 + t) +
+           second * (3.0f * t2 - 2.0f * t3) + secondTangent * (t3 - t2);
+}
+
+inline glm::vec3 InterpolateCubic(const glm::vec3 &previous, const glm::vec3 &first, const glm::vec3 &second, const glm::vec3 &next,
+                                  f32 t, f32 firstWeight, f32 secondWeight)
+{
+    return HermiteCurve(previous, first, second, next, t, firstWeight, secondWeight);
+}
+
+// the keys are moved to the hemisphere of the first one before the curve is
+// evaluated, so the curve never takes the long way around
+inline glm::quat InterpolateCubic(const glm::quat &previous, const glm::quat &first, const glm::quat &second, const glm::quat &next,
+                                  f32 t, f32 firstWeight, f32 secondWeight)
+{
+    glm::vec4 a(first.x, first.y, first.z, first.w);
+    glm::vec4 b(second.x, second.y, second.z, second.w);
+    glm::vec4 p(previous.x, previous.y, previous.z, previous.w);
+    glm::vec4 n(next.x, next.y, next.z, next.w);
+    if(glm::dot(a, b) < 0.0f) b = -b;
+    if(glm::dot(a, p) < 0.0f) p = -p;
+    if(glm::dot(b, n) < 0.0f) n = -n;
+    glm::vec4 result = glm::normalize(HermiteCurve(p, a, b, n, t, firstWeight, secondWeight));
+    return glm::quat(result.w, result.x, result.y, result.z);
+}
+
+template<typename Value>
+inline Value SampleCubicSegment(const AnimationKeys &keys, const AnimationTrack &track, const Value *values,
+                                i32 keyIndex, f32 scaleFactor)
+{
+    i32 previous, next;
+    f32 firstWeight, secondWeight;
+    GetCubicNeighbours(keys, track, keyIndex, &previous, &next, &firstWeight, &secondWeight);
+    return InterpolateCubic(values[previous], values[keyIndex], values[keyIndex + 1], values[next],
+                            scaleFactor, firstWeight, secondWeight);
+}
+
+inline glm::vec3 SamplePosition(const AnimationKeys &keys, i32 trackIndex, f32 animationTime, i32 &cursor)
+{
+    const AnimationTrack &track = keys.positionTracks[trackIndex];
+    const glm::vec3 *positions = &keys.positions[track.keyOffset];
+    if(1 == track.numKeys)
+        return positions[0];
+
+    f32 scaleFactor;
+    i32 p0Index = GetTrackKeyIndex(keys, track, animationTime, cursor, &scaleFactor);
+    if(TRACK_KIND_CUBIC == track.kind)
+        return SampleCubicSegment(keys, track, positions, p0Index, scaleFactor);
+    return glm::mix(positions[p0Index], positions[p0Index + 1], scaleFactor);
+}
+
+inline glm::quat SampleRotation(const AnimationKeys &keys, i32 trackIndex, f32 animationTime, i32 &cursor)
+{
+    const AnimationTrack &track = keys.rotationTracks[trackIndex];
+    const glm::quat *rotations = &keys.rotations[track.keyOffset];
+    if(1 == track.numKeys)
+        return glm::normalize(rotations[0]);
+
+    f32 scaleFactor;
+    i32 p0Index = GetTrackKeyIndex(keys, track, animationTime, cursor, &scaleFactor);
+    if(TRACK_KIND_CUBIC == track.kind)
+        return SampleCubicSegment(keys, track, rotations, p0Index, scaleFactor);
+    glm::quat finalRotation = glm::slerp(rotations[p0Index], rotations[p0Index + 1], scaleFactor);
+    return glm::normalize(finalRotation);
+}
+
+inline glm::vec3 SampleScale(const AnimationKeys &keys, i32 trackIndex, f32 animationTime, i32 &cursor)
+{
+    const AnimationTrack &track = keys.scaleTracks[trackIndex];
+    const glm::vec3 *scales = &keys.scales[track.keyOffset];
+    if(1 == track.numKeys)
+        return scales[0];
+
+    f32 scaleFactor;
+    i32 p0Index = GetTrackKeyIndex(keys, track, animationTime, cursor, &scaleFactor);
+    if(TRACK_KIND_CUBIC == track.kind)
+        return SampleCubicSegment(keys, track, scales, p0Index, scaleFactor);
+    return glm::mix(scales[p0Index], scales[p0Index + 1], scaleFactor);
+}
+
+inline BoneTransform SampleBoneTransform(const AnimationKeys &keys, i32 trackIndex, f32 animationTime, BoneCursor &cursor)
+{
+    BoneTransform transform;
+    transform.translation = SamplePosition(keys, trackIndex, animationTime, cursor.positionIndex);
+    transform.rotation = SampleRotation(keys, trackIndex, animationTime, cursor.rotationIndex);
+    transform.scale = SampleScale(keys, trackIndex, animationTime, cursor.scaleIndex);
+    return transform;
+}
+
+// translate * toMat4(rotation) * scale written out, the rotation columns are
+// scaled in place and the translation goes straight into the last column
+inline glm::mat4 ComposeAffine(const BoneTransform &transform)
+{
+    const glm::quat &q = transform.rotation;
+    const glm::vec3 &s = transform.scale;
+    f32 xx = q.x * q.x;
+    f32 yy = q.y * q.y;
+    f32 zz = q.z * q.z;
+    f32 xy = q.x * q.y;
+    f32 xz = q.x * q.z;
+    f32 yz = q.y * q.z;
+    f32 wx = q.w * q.x;
+    f32 wy = q.w * q.y;
+    f32 wz = q.w * q.z;
+
+    glm::mat4 result;
+    result[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f);
+    result[1] = glm::vec4(2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f);
+    result[2] = glm::vec4(2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f);
+    result[3] = glm::vec4(transform.translation, 1.0f);
+    return result;
+}
+
+// a * b for matrices whose last row is (0, 0, 0, 1)
+inline glm::mat4 MultiplyAffine(const glm::mat4 &a, const glm::mat4 &b)
+{
+    glm::mat4 result;
+    result[0] = a[0] * b[0].x + a[1] * b[0].y + a[2] * b[0].z;
+    result[1] = a[0] * b[1].x + a[1] * b[1].y + a[2] * b[1].z;
+    result[2] = a[0] * b[2].x + a[1] * b[2].y + a[2] * b[2].z;
+    result[3] = a[0] * b[3].x + a[1] * b[3].y + a[2] * b[3].z + a[3];
+    return result;
+}
+
+// angle between two rotations, measured on the chord between the unit
+// quaternions since acos of their dot is too coarse for small angles
+inline f32 GetRotationError(const glm::quat &a, const glm::quat &b)
+{
+    f32 sign = glm::dot(a, b) < 0.0f ? -1.0f : 1.0f;
+    glm::vec4 chord = glm::vec4(a.x, a.y, a.z, a.w) - sign * glm::vec4(b.x, b.y, b.z, b.w);
+    return 4.0f * asinf(fminf(0.5f * glm::length(chord), 1.0f));
+}
+
+inline void AddTrack(AnimationKeys &keys, std::vector<AnimationTrack> &tracks, i32 keyOffset, i32 numKeys)
+{
+    AnimationTrack track;
+    track.timeOffset = (i32)keys.times.size();
+    track.keyOffset = keyOffset;
+    track.numKeys = numKeys;
+    track.kind = numKeys > 1 ? TRACK_KIND_LINEAR_VARIABLE : TRACK_KIND_CONSTANT;
+    track.bucketOffset = 0;
+    track.numBuckets = 0;
+    track.bucketsPerTick = 0.0f;
+    track.timeline = -1;
+    tracks.push_back(track);
+}
+
+// number of entries a track has in AnimationKeys::times
+inline i32 GetTimeCount(const AnimationTrack &track)
+{
+    if(TRACK_KIND_CONSTANT == track.kind) return 1;
+    if(TRACK_KIND_LINEAR_UNIFORM == track.kind) return 2;
+    return track.numKeys;
+}
+
+// a uniform track stores the time of its first key and its keys per tick in
+// place of a time stamp per key
+inline void AddUniformTrack(AnimationKeys &keys, std::vector<AnimationTrack> &tracks, i32 keyOffset, i32 numKeys,
+                            f32 startTime, f32 samplesPerTick)
+{
+    AddTrack(keys, tracks, keyOffset, numKeys);
+    keys.times.push_back(startTime);
+    if(numKeys > 1)
+    {
+        tracks.back().kind = TRACK_KIND_LINEAR_UNIFORM;
+        keys.times.push_back(samplesPerTick);
+    }
+}
+
+// appends the tracks of a channel to the key blocks of the clip
+void AddChannelTracks(AnimationKeys &keys, const aiNodeAnim *channel)
+{
+    i32 numPositions = channel->mNumPositionKeys;
+    AddTrack(keys, keys.positionTracks, (i32)keys.positions.size(), numPositions);
+    for(i32 positionIndex = 0; positionIndex < numPositions; ++positionIndex)
+    {
+        keys.times.push_back((f32)channel->mPositionKeys[positionIndex].mTime);
+        keys.positions.push_back(GetGLMVec(channel->mPositionKeys[positionIndex].mValue));
+    }
+
+    i32 numRotations = channel->mNumRotationKeys;
+    AddTrack(keys, keys.rotationTracks, (i32)keys.rotations.size(), numRotations);
+    for(i32 rotationIndex = 0; rotationIndex < numRotations; ++rotationIndex)
+    {
+        keys.times.push_back((f32)channel->mRotationKeys[rotationIndex].mTime);
+        keys.rotations.push_back(GetGLMQuat(channel->mRotationKeys[rotationIndex].mValue));
+    }
+
+    i32 numScalings = channel->mNumScalingKeys;
+    AddTrack(keys, keys.scaleTracks, (i32)keys.scales.size(), numScalings);
+    for(i32 scaleIndex = 0; scaleIndex < numScalings; ++scaleIndex)
+    {
+        keys.times.push_back((f32)channel->mScalingKeys[scaleIndex].mTime);
+        keys.scales.push_back(GetGLMVec(channel->mScalingKeys[scaleIndex].mValue));
+    }
+}
+
+// resample every track at a fixed rate, after this the key index of a sample
+// is just floor(animationTime * samplesPerTick). Reports the largest error of
+// the baked tracks measured at the source key times
+void BakeAnimationKeys(const AnimationKeys &source, f32 samplesPerTick, f32 duration,
+                       AnimationKeys *baked, f32 *positionError, f32 *rotationError)
+{
+    Assert(samplesPerTick > 0.0f);
+    i32 numSamples = (i32)ceilf(duration * samplesPerTick) + 1;
+    if(numSamples < 2) numSamples = 2;
+
+    *baked = {};
+    baked->samplesPerTick = samplesPerTick;
+    i32 trackCount = (i32)source.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        // constant tracks keep their single key
+        i32 numPositions = source.positionTracks[trackIndex].numKeys > 1 ? numSamples : 1;
+        i32 numRotations = source.rotationTracks[trackIndex].numKeys > 1 ? numSamples : 1;
+        i32 numScales = source.scaleTracks[trackIndex].numKeys > 1 ? numSamples : 1;
+
+        AddUniformTrack(*baked, baked->positionTracks, (i32)baked->positions.size(), numPositions, 0.0f, samplesPerTick);
+        AddUniformTrack(*baked, baked->rotationTracks, (i32)baked->rotations.size(), numRotations, 0.0f, samplesPerTick);
+        AddUniformTrack(*baked, baked->scaleTracks, (i32)baked->scales.size(), numScales, 0.0f, samplesPerTick);
+
+        BoneCursor cursor = {};
+        for(i32 sampleIndex = 0; sampleIndex < numSamples; ++sampleIndex)
         {
-            aiVector3D scale = channel->mScalingKeys[scaleIndex].mValue;
-            f32 timeStamp = (f32)channel->mScalingKeys[scaleIndex].mTime;
-            KeyScale data;
-            data.scale = GetGLMVec(scale);
-            data.timeStamp = timeStamp;
-            mScales.push_back(data);
+            // the rate rarely divides the duration, the last sample would
+            // lie past the end of the clip and takes the end pose instead
+            f32 sampleTime = fminf((f32)sampleIndex / samplesPerTick, duration);
+            if(sampleIndex < numPositions)
+                baked->positions.push_back(SamplePosition(source, trackIndex, sampleTime, cursor.positionIndex));
+            if(sampleIndex < numRotations)
+                baked->rotations.push_back(SampleRotation(source, trackIndex, sampleTime, cursor.rotationIndex));
+            if(sampleIndex < numScales)
+                baked->scales.push_back(SampleScale(source, trackIndex, sampleTime, cursor.scaleIndex));
         }
     }
 
-    void Update(f32 animationTime)
+    *positionError = 0.0f;
+    *rotationError = 0.0f;
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
     {
-        glm::mat4 translation = InterpolatePosition(animationTime);
-        glm::mat4 rotation = InterpolateRotation(animationTime);
-        glm::mat4 scale = InterpolateScale(animationTime);
-        mLocalTransform = translation * rotation * scale; 
+        const AnimationTrack &positionTrack = source.positionTracks[trackIndex];
+        for(i32 keyIndex = 0; keyIndex < positionTrack.numKeys; ++keyIndex)
+        {
+            i32 cursor = 0;
+            f32 keyTime = source.times[positionTrack.timeOffset + keyIndex];
+            glm::vec3 key = source.positions[positionTrack.keyOffset + keyIndex];
+            f32 error = glm::length(SamplePosition(*baked, trackIndex, keyTime, cursor) - key);
+            *positionError = fmaxf(*positionError, error);
+        }
+
+        const AnimationTrack &rotationTrack = source.rotationTracks[trackIndex];
+        for(i32 keyIndex = 0; keyIndex < rotationTrack.numKeys; ++keyIndex)
+        {
+            i32 cursor = 0;
+            f32 keyTime = source.times[rotationTrack.timeOffset + keyIndex];
+            glm::quat key = glm::normalize(source.rotations[rotationTrack.keyOffset + keyIndex]);
+            f32 error = GetRotationError(SampleRotation(*baked, trackIndex, keyTime, cursor), key);
+            *rotationError = fmaxf(*rotationError, error);
+        }
+
+        // and halfway between the samples, where a wrong last sample shows
+        BoneCursor sourceCursor = {};
+        BoneCursor bakedCursor = {};
+        for(i32 sampleIndex = 0; sampleIndex < numSamples - 1; ++sampleIndex)
+        {
+            f32 sampleTime = fminf((sampleIndex + 0.5f) / samplesPerTick, duration);
+            BoneTransform expected = SampleBoneTransform(source, trackIndex, sampleTime, sourceCursor);
+            BoneTransform actual = SampleBoneTransform(*baked, trackIndex, sampleTime, bakedCursor);
+            *positionError = fmaxf(*positionError, glm::length(actual.translation - expected.translation));
+            *rotationError = fmaxf(*rotationError, GetRotationError(actual.rotation, expected.rotation));
+        }
     }
+}
+
+#define CONSTANT_TRACK_EPSILON 0.00001f
 
-    glm::mat4 GetLocalTransform()
+enum TrackClass
+{
+    TRACK_ANIMATED,
+    TRACK_CONSTANT,
+    TRACK_IDENTITY, // constant and equal to the rest value of its kind
+    TRACK_CLASS_COUNT
+};
+
+// what the import passes did to the tracks of a clip, kept with the clip so
+// the load path stays quiet. The fields of passes that did not run stay 0
+struct TrackStats
+{
+    // number of position, rotation and scale tracks of each class
+    i32 positions[TRACK_CLASS_COUNT];
+    i32 rotations[TRACK_CLASS_COUNT];
+    i32 scales[TRACK_CLASS_COUNT];
+    i32 staticBones; // folded into the bind transforms of their nodes
+
+    i32 sourceKeys; // positions, rotations and scales before the reduction
+    i32 reducedKeys;
+
+    i32 bakedSamples; // per animated track
+    f32 bakePositionError;
+    f32 bakeRotationError; // radians
+
+    i32 kinds[TRACK_KIND_COUNT]; // position, rotation and scale tracks of each kind
+
+    i32 timelines;         // key times shared by the tracks
+    i32 searchedTimelines; // that need a key search per sample
+    i32 sourceTimes;       // key times before the sharing
+    i32 sharedTimes;
+
+    u64 floatKeyBytes; // before the quantization
+    f32 quantizePositionError;
+    f32 quantizeRotationError; // radians
+    f32 quantizeScaleError;
+};
+
+inline TrackClass ClassifyVec3Track(const glm::vec3 *keys, i32 numKeys, glm::vec3 identity)
+{
+    for(i32 keyIndex = 1; keyIndex < numKeys; ++keyIndex)
     {
-        return mLocalTransform;
+        if(glm::length(keys[keyIndex] - keys[0]) > CONSTANT_TRACK_EPSILON) return TRACK_ANIMATED;
     }
+    if(glm::length(keys[0] - identity) > CONSTANT_TRACK_EPSILON) return TRACK_CONSTANT;
+    return TRACK_IDENTITY;
+}
 
-    std::string GetBoneName() const
+inline TrackClass ClassifyRotationTrack(const glm::quat *keys, i32 numKeys)
+{
+    glm::quat first = glm::normalize(keys[0]);
+    for(i32 keyIndex = 1; keyIndex < numKeys; ++keyIndex)
     {
-        return mName;
+        if(GetRotationError(glm::normalize(keys[keyIndex]), first) > CONSTANT_TRACK_EPSILON) return TRACK_ANIMATED;
     }
+    if(GetRotationError(first, glm::quat(1.0f, 0.0f, 0.0f, 0.0f)) > CONSTANT_TRACK_EPSILON) return TRACK_CONSTANT;
+    return TRACK_IDENTITY;
+}
 
-    i32 GetBoneID()
+// stores every track whose keys never change as a single key, so it is
+// written once per pose instead of sampled every frame
+void FoldConstantTracks(const AnimationKeys &source, AnimationKeys *folded, TrackStats *stats)
+{
+    Assert(source.samplesPerTick <= 0.0f);
+    *folded = {};
+    *stats = {};
+
+    i32 trackCount = (i32)source.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
     {
-        return mID;
+        const AnimationTrack &positionTrack = source.positionTracks[trackIndex];
+        const f32 *positionTimes = &source.times[positionTrack.timeOffset];
+        const glm::vec3 *positions = &source.positions[positionTrack.keyOffset];
+        TrackClass positionClass = ClassifyVec3Track(positions, positionTrack.numKeys, glm::vec3(0.0f));
+        i32 numPositions = TRACK_ANIMATED == positionClass ? positionTrack.numKeys : 1;
+        stats->positions[positionClass]++;
+        AddTrack(*folded, folded->positionTracks, (i32)folded->positions.size(), numPositions);
+        for(i32 keyIndex = 0; keyIndex < numPositions; ++keyIndex)
+        {
+            folded->times.push_back(positionTimes[keyIndex]);
+            folded->positions.push_back(positions[keyIndex]);
+        }
+
+        const AnimationTrack &rotationTrack = source.rotationTracks[trackIndex];
+        const f32 *rotationTimes = &source.times[rotationTrack.timeOffset];
+        const glm::quat *rotations = &source.rotations[rotationTrack.keyOffset];
+        TrackClass rotationClass = ClassifyRotationTrack(rotations, rotationTrack.numKeys);
+        i32 numRotations = TRACK_ANIMATED == rotationClass ? rotationTrack.numKeys : 1;
+        stats->rotations[rotationClass]++;
+        AddTrack(*folded, folded->rotationTracks, (i32)folded->rotations.size(), numRotations);
+        for(i32 keyIndex = 0; keyIndex < numRotations; ++keyIndex)
+        {
+            folded->times.push_back(rotationTimes[keyIndex]);
+            folded->rotations.push_back(rotations[keyIndex]);
+        }
+
+        const AnimationTrack &scaleTrack = source.scaleTracks[trackIndex];
+        const f32 *scaleTimes = &source.times[scaleTrack.timeOffset];
+        const glm::vec3 *scales = &source.scales[scaleTrack.keyOffset];
+        TrackClass scaleClass = ClassifyVec3Track(scales, scaleTrack.numKeys, glm::vec3(1.0f));
+        i32 numScales = TRACK_ANIMATED == scaleClass ? scaleTrack.numKeys : 1;
+        stats->scales[scaleClass]++;
+        AddTrack(*folded, folded->scaleTracks, (i32)folded->scales.size(), numScales);
+        for(i32 keyIndex = 0; keyIndex < numScales; ++keyIndex)
+        {
+            folded->times.push_back(scaleTimes[keyIndex]);
+            folded->scales.push_back(scales[keyIndex]);
+        }
     }
+}
+
+inline bool IsStaticTrack(const AnimationKeys &keys, i32 trackIndex)
+{
+    return keys.positionTracks[trackIndex].numKeys == 1 &&
+           keys.rotationTracks[trackIndex].numKeys == 1 &&
+           keys.scaleTracks[trackIndex].numKeys == 1;
+}
 
-    i32 GetPositionIndex(f32 animationTime)
+#define UNIFORM_TRACK_EPSILON 0.0001f
+
+// keys at a fixed rate, up to a small part of a key interval
+inline bool IsUniformTrack(const f32 *times, i32 numKeys)
+{
+    f32 interval = times[1] - times[0];
+    if(interval <= 0.0f) return false;
+    for(i32 keyIndex = 2; keyIndex < numKeys; ++keyIndex)
+    {
+        f32 expected = times[0] + interval * (f32)keyIndex;
+        if(fabsf(times[keyIndex] - expected) > UNIFORM_TRACK_EPSILON * interval) return false;
+    }
+    return true;
+}
+
+// stepped curves come out of the importers as pairs of keys, the value is
+// held through a segment and jumps in a segment that takes no time. Every
+// key that starts a hold is kept, those are the steps
+template<typename Value, typename IsSameValue>
+internal bool FindTrackSteps(const f32 *times, const Value *values, i32 numKeys, IsSameValue isSameValue,
+                             std::vector<i32> &steps)
+{
+    f32 jumpLength = UNIFORM_TRACK_EPSILON * (times[numKeys - 1] - times[0]);
+    i32 jumps = 0;
+    steps.clear();
+    steps.push_back(0);
+    for(i32 keyIndex = 1; keyIndex < numKeys; ++keyIndex)
     {
-        for(i32 index = 0; index < mNumPositions - 1; ++index)
+        bool held = isSameValue(values[keyIndex - 1], values[keyIndex]);
+        bool jump = times[keyIndex] - times[keyIndex - 1] <= jumpLength;
+        if(!held && !jump) return false;
+        if(!held)
         {
-            if(animationTime < mPositions[index + 1].timeStamp)
-            {
-                return index;
-            }
+            steps.push_back(keyIndex);
+            ++jumps;
         }
-        Assert(0);
-        return -1;
     }
+    return jumps > 0;
+}
 
-    i32 GetRotationIndex(f32 animationTime)
+template<typename Value, typename IsSameValue>
+internal void AddClassifiedTrack(const AnimationKeys &source, const AnimationTrack &track, const std::vector<Value> &sourceValues,
+                                 IsSameValue isSameValue, AnimationKeys *classified,
+                                 std::vector<AnimationTrack> &tracks, std::vector<Value> &values, std::vector<i32> &steps)
+{
+    const f32 *times = &source.times[track.timeOffset];
+    const Value *keys = &sourceValues[track.keyOffset];
+    if(track.kind != TRACK_KIND_LINEAR_VARIABLE)
+    {
+        AddTrack(*classified, tracks, (i32)values.size(), track.numKeys);
+        tracks.back().kind = track.kind;
+        classified->times.insert(classified->times.end(), times, times + GetTimeCount(track));
+        values.insert(values.end(), keys, keys + track.numKeys);
+    }
+    else if(IsUniformTrack(times, track.numKeys))
+    {
+        AddUniformTrack(*classified, tracks, (i32)values.size(), track.numKeys, times[0], 1.0f / (times[1] - times[0]));
+        values.insert(values.end(), keys, keys + track.numKeys);
+    }
+    else if(FindTrackSteps(times, keys, track.numKeys, isSameValue, steps))
     {
-        for(i32 index = 0; index < mNumRotations - 1; ++index)
+        AddTrack(*classified, tracks, (i32)values.size(), (i32)steps.size());
+        tracks.back().kind = TRACK_KIND_STEPPED;
+        for(i32 keyIndex : steps)
         {
-            if(animationTime < mRotations[index + 1].timeStamp)
-            {
-                return index;
-            }
+            classified->times.push_back(times[keyIndex]);
+            values.push_back(keys[keyIndex]);
         }
-        Assert(0);
-        return -1;
     }
+    else
+    {
+        AddTrack(*classified, tracks, (i32)values.size(), track.numKeys);
+        classified->times.insert(classified->times.end(), times, times + track.numKeys);
+        values.insert(values.end(), keys, keys + track.numKeys);
+    }
+}
+
+// finds the kind of every variable rate track. Uniform tracks drop their
+// time stamps and stepped tracks keep one key per step
+void ClassifyTrackKinds(const AnimationKeys &source, AnimationKeys *classified)
+{
+    *classified = {};
+    classified->samplesPerTick = source.samplesPerTick;
+    std::vector<i32> steps;
 
-    i32 GetScaleIndex(f32 animationTime)
+    auto isSameVec3 = [](const glm::vec3 &a, const glm::vec3 &b)
     {
-        for(i32 index = 0; index < mNumScalings - 1; ++index)
+        return glm::length(a - b) <= CONSTANT_TRACK_EPSILON;
+    };
+    auto isSameQuat = [](const glm::quat &a, const glm::quat &b)
+    {
+        return GetRotationError(glm::normalize(a), glm::normalize(b)) <= CONSTANT_TRACK_EPSILON;
+    };
+
+    i32 trackCount = (i32)source.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        AddClassifiedTrack(source, source.positionTracks[trackIndex], source.positions, isSameVec3,
+                           classified, classified->positionTracks, classified->positions, steps);
+        AddClassifiedTrack(source, source.rotationTracks[trackIndex], source.rotations, isSameQuat,
+                           classified, classified->rotationTracks, classified->rotations, steps);
+        AddClassifiedTrack(source, source.scaleTracks[trackIndex], source.scales, isSameVec3,
+                           classified, classified->scaleTracks, classified->scales, steps);
+    }
+}
+
+internal void BuildTrackBatches(const std::vector<AnimationTrack> &tracks, TrackBatches &batches)
+{
+    for(i32 kind = 0; kind < TRACK_KIND_COUNT; ++kind)
+    {
+        batches.tracks[kind].clear();
+    }
+    for(i32 trackIndex = 0; trackIndex < (i32)tracks.size(); ++trackIndex)
+    {
+        if(tracks[trackIndex].kind != TRACK_KIND_CONSTANT)
         {
-            if(animationTime < mScales[index + 1].timeStamp)
-            {
-                return index;
-            }
+            batches.tracks[tracks[trackIndex].kind].push_back(trackIndex);
+        }
+    }
+}
+
+// has to run again every time the tracks of the clip are rebuilt
+void BuildTrackBatches(AnimationKeys &keys)
+{
+    BuildTrackBatches(keys.positionTracks, keys.positionBatches);
+    BuildTrackBatches(keys.rotationTracks, keys.rotationBatches);
+    BuildTrackBatches(keys.scaleTracks, keys.scaleBatches);
+    BuildTrackBatches(keys.timelines, keys.timelineBatches);
+}
+
+internal i32 FindTimeline(const AnimationKeys &keys, const AnimationTrack &track, const f32 *times)
+{
+    for(i32 timelineIndex = 0; timelineIndex < (i32)keys.timelines.size(); ++timelineIndex)
+    {
+        const AnimationTrack &timeline = keys.timelines[timelineIndex];
+        if(timeline.kind == track.kind && timeline.numKeys == track.numKeys &&
+           std::equal(times, times + GetTimeCount(track), &keys.times[timeline.timeOffset]))
+        {
+            return timelineIndex;
+        }
+    }
+    return -1;
+}
+
+internal void ShareTrackTimes(const std::vector<f32> &sourceTimes, AnimationKeys &keys, std::vector<AnimationTrack> &tracks)
+{
+    for(AnimationTrack &track : tracks)
+    {
+        const f32 *times = &sourceTimes[track.timeOffset];
+        track.timeline = FindTimeline(keys, track, times);
+        if(track.timeline < 0)
+        {
+            track.timeline = (i32)keys.timelines.size();
+            AnimationTrack timeline = track;
+            timeline.timeOffset = (i32)keys.times.size();
+            timeline.keyOffset = 0;
+            keys.timelines.push_back(timeline);
+            keys.times.insert(keys.times.end(), times, times + GetTimeCount(track));
+        }
+        track.timeOffset = keys.timelines[track.timeline].timeOffset;
+    }
+}
+
+// tracks with the same kind and key times, which is most of them for clips
+// exported with a key on every channel at the same frames, end up on one
+// timeline. Their times are stored once and the pose sampler searches each
+// timeline once per sample instead of every track
+void ShareTimelines(AnimationKeys &keys)
+{
+    std::vector<f32> sourceTimes;
+    sourceTimes.swap(keys.times);
+    keys.timelines.clear();
+    ShareTrackTimes(sourceTimes, keys, keys.positionTracks);
+    ShareTrackTimes(sourceTimes, keys, keys.rotationTracks);
+    ShareTrackTimes(sourceTimes, keys, keys.scaleTracks);
+}
+
+// a bucket per KEY_BUCKET_KEYS keys of the track, spread evenly over its time
+// span. Every bucket stores the last segment that starts in an earlier bucket,
+// the keys are put in buckets with the same math as the lookup so a sample
+// never starts its scan past its own segment
+internal void BuildTrackBuckets(const f32 *times, AnimationTrack &track, std::vector<i32> &buckets)
+{
+    f32 span = times[track.numKeys - 1] - times[0];
+    track.bucketOffset = (i32)buckets.size();
+    track.numBuckets = span > 0.0f ? std::max(1, track.numKeys / KEY_BUCKET_KEYS) : 1;
+    track.bucketsPerTick = span > 0.0f ? (f32)track.numBuckets / span : 0.0f;
+
+    i32 index = 0;
+    for(i32 bucket = 0; bucket < track.numBuckets; ++bucket)
+    {
+        while(index < track.numKeys - 2 &&
+              GetKeyBucket(times[0], track.numBuckets, track.bucketsPerTick, times[index + 1]) < bucket)
+        {
+            ++index;
         }
-        Assert(0);
-        return -1;
+        buckets.push_back(index);
     }
-private:
-    f32 GetScaleFactor(f32 lastTimeStamp, f32 nextTimeStamp, f32 animationTime)
+}
+
+internal void BuildTrackBuckets(AnimationKeys &keys, std::vector<AnimationTrack> &tracks)
+{
+    for(AnimationTrack &track : tracks)
     {
-        f32 scaleFactor = 0.0f;
-        f32 midWayLength = animationTime - lastTimeStamp;
-        f32 framesDiff = nextTimeStamp - lastTimeStamp;
-        scaleFactor = midWayLength / framesDiff;
-        return scaleFactor;
+        track.numBuckets = 0;
+        bool searched = TRACK_KIND_LINEAR_VARIABLE == track.kind || TRACK_KIND_STEPPED == track.kind ||
+                        TRACK_KIND_CUBIC == track.kind;
+        if(searched && track.numKeys > 2)
+        {
+            BuildTrackBuckets(&keys.times[track.timeOffset], track, keys.buckets);
+        }
     }
+}
 
-    glm::mat4 InterpolatePosition(f32 animationTime)
+// tracks on a timeline use its time index
+internal void CopyTimelineBuckets(const AnimationKeys &keys, std::vector<AnimationTrack> &tracks)
+{
+    for(AnimationTrack &track : tracks)
     {
-        if(1 == mNumPositions)
-           return glm::translate(glm::mat4(1.0f), mPositions[0].position);
-        i32 p0Index = GetPositionIndex(animationTime);
-        i32 p1Index = p0Index + 1;
-        f32 scaleFactor = GetScaleFactor(mPositions[p0Index].timeStamp, 
-                                         mPositions[p1Index].timeStamp,
-                                         animationTime);
-        glm::vec3 finalPosition = glm::mix(mPositions[p0Index].position, mPositions[p1Index].position, scaleFactor);
-        return glm::translate(glm::mat4(1.0f), finalPosition); 
+        Assert(track.timeline >= 0);
+        const AnimationTrack &timeline = keys.timelines[track.timeline];
+        track.bucketOffset = timeline.bucketOffset;
+        track.numBuckets = timeline.numBuckets;
+        track.bucketsPerTick = timeline.bucketsPerTick;
     }
+}
+
+// time index of every timeline that is searched by time stamp, has to run
+// again every time the tracks of the clip are rebuilt
+void BuildKeyBuckets(AnimationKeys &keys)
+{
+    keys.buckets.clear();
+    BuildTrackBuckets(keys, keys.timelines);
+    CopyTimelineBuckets(keys, keys.positionTracks);
+    CopyTimelineBuckets(keys, keys.rotationTracks);
+    CopyTimelineBuckets(keys, keys.scaleTracks);
+}
 
-    glm::mat4 InterpolateRotation(f32 animationTime)
+// greedy pass over the keys of a track, a key is dropped when the segment
+// from the last kept key to the key after it rebuilds every key in between
+// within tolerance. The first and last keys are always kept
+template<typename SegmentTest>
+internal void SelectTrackKeys(i32 numKeys, SegmentTest isWithinTolerance, std::vector<i32> &kept)
+{
+    kept.clear();
+    kept.push_back(0);
+    for(i32 keyIndex = 1; keyIndex < numKeys - 1; ++keyIndex)
     {
-        if(1 == mNumRotations)
+        if(!isWithinTolerance(kept.back(), keyIndex + 1))
         {
-            auto rotation = glm::normalize(mRotations[0].orientation);
-            return glm::toMat4(rotation);
+            kept.push_back(keyIndex);
         }
+    }
+    if(numKeys > 1) kept.push_back(numKeys - 1);
+}
+
+// 0 at the first key of a segment, 1 at the last one
+inline f32 GetSegmentFactor(const f32 *times, i32 first, i32 last, i32 keyIndex)
+{
+    return GetScaleFactor(times[first], times[last], times[keyIndex]);
+}
+
+// drops the keys that interpolation between their neighbours rebuilds within
+// tolerance. reaches[i] is how far the subtree of bone i extends, rotation and
+// scale errors are turned into the distance they move it so positionTolerance
+// bounds the model space error of every bone. Only for clips that keep their
+// source key times
+void ReduceAnimationKeys(const AnimationKeys &source, const f32 *reaches,
+                         f32 positionTolerance, f32 rotationTolerance, AnimationKeys *reduced)
+{
+    Assert(source.samplesPerTick <= 0.0f);
+    *reduced = {};
+    std::vector<i32> kept;
 
-        i32 p0Index = GetRotationIndex(animationTime);
-        i32 p1Index = p0Index + 1;
-        f32 scaleFactor = GetScaleFactor(mRotations[p0Index].timeStamp,
-                                         mRotations[p1Index].timeStamp,
-                                         animationTime);
-        glm::quat finalRotation = glm::slerp(mRotations[p0Index].orientation, mRotations[p1Index].orientation, scaleFactor);
-        finalRotation = glm::normalize(finalRotation);
-        return glm::toMat4(finalRotation);
+    i32 trackCount = (i32)source.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        // a scale error on a leaf still moves the vertices around it
+        f32 reach = reaches[trackIndex];
+        f32 scaleReach = fmaxf(reach, 1.0f);
+
+        const AnimationTrack &positionTrack = source.positionTracks[trackIndex];
+        const f32 *positionTimes = &source.times[positionTrack.timeOffset];
+        const glm::vec3 *positions = &source.positions[positionTrack.keyOffset];
+        SelectTrackKeys(positionTrack.numKeys, [&](i32 first, i32 last)
+        {
+            for(i32 keyIndex = first + 1; keyIndex < last; ++keyIndex)
+            {
+                f32 t = GetSegmentFactor(positionTimes, first, last, keyIndex);
+                glm::vec3 rebuilt = glm::mix(positions[first], positions[last], t);
+                if(glm::length(rebuilt - positions[keyIndex]) > positionTolerance) return false;
+            }
+            return true;
+        }, kept);
+        AddTrack(*reduced, reduced->positionTracks, (i32)reduced->positions.size(), (i32)kept.size());
+        for(i32 keyIndex : kept)
+        {
+            reduced->times.push_back(positionTimes[keyIndex]);
+            reduced->positions.push_back(positions[keyIndex]);
+        }
+
+        const AnimationTrack &rotationTrack = source.rotationTracks[trackIndex];
+        const f32 *rotationTimes = &source.times[rotationTrack.timeOffset];
+        const glm::quat *rotations = &source.rotations[rotationTrack.keyOffset];
+        SelectTrackKeys(rotationTrack.numKeys, [&](i32 first, i32 last)
+        {
+            for(i32 keyIndex = first + 1; keyIndex < last; ++keyIndex)
+            {
+                f32 t = GetSegmentFactor(rotationTimes, first, last, keyIndex);
+                glm::quat rebuilt = glm::normalize(glm::slerp(rotations[first], rotations[last], t));
+                f32 error = GetRotationError(rebuilt, glm::normalize(rotations[keyIndex]));
+                if(error > rotationTolerance) return false;
+                if(2.0f * reach * sinf(0.5f * error) > positionTolerance) return false;
+            }
+            return true;
+        }, kept);
+        AddTrack(*reduced, reduced->rotationTracks, (i32)reduced->rotations.size(), (i32)kept.size());
+        for(i32 keyIndex : kept)
+        {
+            reduced->times.push_back(rotationTimes[keyIndex]);
+            reduced->rotations.push_back(rotations[keyIndex]);
+        }
+
+        const AnimationTrack &scaleTrack = source.scaleTracks[trackIndex];
+        const f32 *scaleTimes = &source.times[scaleTrack.timeOffset];
+        const glm::vec3 *scales = &source.scales[scaleTrack.keyOffset];
+        SelectTrackKeys(scaleTrack.numKeys, [&](i32 first, i32 last)
+        {
+            for(i32 keyIndex = first + 1; keyIndex < last; ++keyIndex)
+            {
+                f32 t = GetSegmentFactor(scaleTimes, first, last, keyIndex);
+                glm::vec3 rebuilt = glm::mix(scales[first], scales[last], t);
+                if(glm::length(rebuilt - scales[keyIndex]) * scaleReach > positionTolerance) return false;
+            }
+            return true;
+        }, kept);
+        AddTrack(*reduced, reduced->scaleTracks, (i32)reduced->scales.size(), (i32)kept.size());
+        for(i32 keyIndex : kept)
+        {
+            reduced->times.push_back(scaleTimes[keyIndex]);
+            reduced->scales.push_back(scales[keyIndex]);
+        }
+    }
+}
+
+// error of a key against its tolerance, above 1 is out of tolerance. A zero
+// tolerance keeps every key that is not rebuilt exactly
+inline f32 GetToleranceRatio(f32 error, f32 tolerance)
+{
+    return error / fmaxf(tolerance, 1e-20f);
+}
+
+// starts with a curve through the first and last key and adds the key the
+// curve misses the most until every key is within tolerance. keyError(previous,
+// first, second, next, keyIndex) is the tolerance ratio at keyIndex of the
+// segment from first to second. The worst key of every segment is cached and
+// only the segments whose curve an added key changes are measured again
+template<typename KeyError>
+internal void SelectCubicKeys(i32 numKeys, KeyError keyError, std::vector<i32> &kept)
+{
+    kept.clear();
+    kept.push_back(0);
+    if(numKeys > 1) kept.push_back(numKeys - 1);
+
+    std::vector<i32> worstKeys;
+    std::vector<f32> worstErrors;
+    auto measureSegment = [&](i32 segment)
+    {
+        i32 lastSegment = (i32)kept.size() - 2;
+        i32 previous = kept[segment > 0 ? segment - 1 : segment];
+        i32 next = kept[segment < lastSegment ? segment + 2 : segment + 1];
+        worstKeys[segment] = -1;
+        worstErrors[segment] = 1.0f;
+        for(i32 keyIndex = kept[segment] + 1; keyIndex < kept[segment + 1]; ++keyIndex)
+        {
+            f32 error = keyError(previous, kept[segment], kept[segment + 1], next, keyIndex);
+            if(error > worstErrors[segment])
+            {
+                worstKeys[segment] = keyIndex;
+                worstErrors[segment] = error;
+            }
+        }
+    };
+
+    i32 segmentCount = (i32)kept.size() - 1;
+    worstKeys.resize(segmentCount);
+    worstErrors.resize(segmentCount);
+    for(i32 segment = 0; segment < segmentCount; ++segment) measureSegment(segment);
+
+    for(;;)
+    {
+        i32 worstSegment = -1;
+        for(i32 segment = 0; segment < (i32)worstKeys.size(); ++segment)
+        {
+            if(worstKeys[segment] >= 0 && (worstSegment < 0 || worstErrors[segment] > worstErrors[worstSegment]))
+                worstSegment = segment;
+        }
+        if(worstSegment < 0) break;
+
+        // the added key splits its segment in two and is a neighbour of the
+        // segments on either side
+        kept.insert(kept.begin() + worstSegment + 1, worstKeys[worstSegment]);
+        worstKeys.insert(worstKeys.begin() + worstSegment, -1);
+        worstErrors.insert(worstErrors.begin() + worstSegment, 0.0f);
+        i32 firstChanged = worstSegment > 0 ? worstSegment - 1 : 0;
+        i32 lastChanged = std::min(worstSegment + 2, (i32)worstKeys.size() - 1);
+        for(i32 segment = firstChanged; segment <= lastChanged; ++segment) measureSegment(segment);
     }
+}
 
-    glm::mat4 InterpolateScale(f32 animationTime)
+// the curve through the kept keys of a track when it needs fewer keys than
+// the linear reduction of the same track, the linear track otherwise
+template<typename Value>
+internal void AddFittedTrack(AnimationKeys *fitted, std::vector<AnimationTrack> &tracks, std::vector<Value> &values,
+                             const f32 *times, const Value *keys, const std::vector<i32> &kept,
+                             const AnimationKeys &linear, const AnimationTrack &linearTrack,
+                             const std::vector<Value> &linearValues)
+{
+    if((i32)kept.size() > 2 && (i32)kept.size() < linearTrack.numKeys)
     {
-        if(1 == mNumScalings)
-           return glm::scale(glm::mat4(1.0f), mScales[0].scale);
-        
-        i32 p0Index = GetScaleIndex(animationTime);
-        i32 p1Index = p0Index + 1;
-        f32 scaleFactor = GetScaleFactor(mScales[p0Index].timeStamp,
-                                         mScales[p1Index].timeStamp,
-                                         animationTime);
-        glm::vec3 finalScale = glm::mix(mScales[p0Index].scale, mScales[p1Index].scale, scaleFactor);
-        return glm::scale(glm::mat4(1.0f), finalScale);
+        AddTrack(*fitted, tracks, (i32)values.size(), (i32)kept.size());
+        tracks.back().kind = TRACK_KIND_CUBIC;
+        for(i32 keyIndex : kept)
+        {
+            fitted->times.push_back(times[keyIndex]);
+            values.push_back(keys[keyIndex]);
+        }
     }
+    else
+    {
+        const f32 *linearTimes = &linear.times[linearTrack.timeOffset];
+        const Value *linearKeys = &linearValues[linearTrack.keyOffset];
+        AddTrack(*fitted, tracks, (i32)values.size(), linearTrack.numKeys);
+        fitted->times.insert(fitted->times.end(), linearTimes, linearTimes + linearTrack.numKeys);
+        values.insert(values.end(), linearKeys, linearKeys + linearTrack.numKeys);
+    }
+}
 
-    std::vector<KeyPosition> mPositions;
-    std::vector<KeyRotation> mRotations;
-    std::vector<KeyScale> mScales;
+// fits a Catmull-Rom curve to every animated track with as few of its keys as
+// the tolerances allow, smooth motion needs far fewer keys than with linear
+// segments. The tolerances mean the same as for ReduceAnimationKeys. A track
+// whose curve saves nothing over linear reduction stays linear, the curve
+// overshoots between keys of motion that is not smooth
+void FitCubicTracks(const AnimationKeys &source, const f32 *reaches,
+                    f32 positionTolerance, f32 rotationTolerance, AnimationKeys *fitted)
+{
+    Assert(source.samplesPerTick <= 0.0f);
+    AnimationKeys linear;
+    ReduceAnimationKeys(source, reaches, positionTolerance, rotationTolerance, &linear);
 
-    i32 mNumPositions;
-    i32 mNumRotations;
-    i32 mNumScalings;
+    *fitted = {};
+    std::vector<i32> kept;
 
-    glm::mat4 mLocalTransform;
-    std::string mName;
-    i32 mID;
-};
+    i32 trackCount = (i32)source.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        f32 reach = reaches[trackIndex];
+        f32 scaleReach = fmaxf(reach, 1.0f);
+
+        const AnimationTrack &positionTrack = source.positionTracks[trackIndex];
+        const f32 *positionTimes = &source.times[positionTrack.timeOffset];
+        const glm::vec3 *positions = &source.positions[positionTrack.keyOffset];
+        SelectCubicKeys(positionTrack.numKeys, [&](i32 previous, i32 first, i32 second, i32 next, i32 keyIndex)
+        {
+            f32 firstWeight, secondWeight;
+            GetCubicWeights(positionTimes[previous], positionTimes[first], positionTimes[second], positionTimes[next],
+                            &firstWeight, &secondWeight);
+            f32 t = GetSegmentFactor(positionTimes, first, second, keyIndex);
+            glm::vec3 rebuilt = InterpolateCubic(positions[previous], positions[first], positions[second], positions[next],
+                                                 t, firstWeight, secondWeight);
+            return GetToleranceRatio(glm::length(rebuilt - positions[keyIndex]), positionTolerance);
+        }, kept);
+        AddFittedTrack(fitted, fitted->positionTracks, fitted->positions, positionTimes, positions, kept,
+                       linear, linear.positionTracks[trackIndex], linear.positions);
+
+        const AnimationTrack &rotationTrack = source.rotationTracks[trackIndex];
+        const f32 *rotationTimes = &source.times[rotationTrack.timeOffset];
+        const glm::quat *rotations = &source.rotations[rotationTrack.keyOffset];
+        SelectCubicKeys(rotationTrack.numKeys, [&](i32 previous, i32 first, i32 second, i32 next, i32 keyIndex)
+        {
+            f32 firstWeight, secondWeight;
+            GetCubicWeights(rotationTimes[previous], rotationTimes[first], rotationTimes[second], rotationTimes[next],
+                            &firstWeight, &secondWeight);
+            f32 t = GetSegmentFactor(rotationTimes, first, second, keyIndex);
+            glm::quat rebuilt = InterpolateCubic(rotations[previous], rotations[first], rotations[second], rotations[next],
+                                                 t, firstWeight, secondWeight);
+            f32 error = GetRotationError(rebuilt, glm::normalize(rotations[keyIndex]));
+            return fmaxf(GetToleranceRatio(error, rotationTolerance),
+                         GetToleranceRatio(2.0f * reach * sinf(0.5f * error), positionTolerance));
+        }, kept);
+        AddFittedTrack(fitted, fitted->rotationTracks, fitted->rotations, rotationTimes, rotations, kept,
+                       linear, linear.rotationTracks[trackIndex], linear.rotations);
+
+        const AnimationTrack &scaleTrack = source.scaleTracks[trackIndex];
+        const f32 *scaleTimes = &source.times[scaleTrack.timeOffset];
+        const glm::vec3 *scales = &source.scales[scaleTrack.keyOffset];
+        SelectCubicKeys(scaleTrack.numKeys, [&](i32 previous, i32 first, i32 second, i32 next, i32 keyIndex)
+        {
+            f32 firstWeight, secondWeight;
+            GetCubicWeights(scaleTimes[previous], scaleTimes[first], scaleTimes[second], scaleTimes[next],
+                            &firstWeight, &secondWeight);
+            f32 t = GetSegmentFactor(scaleTimes, first, second, keyIndex);
+            glm::vec3 rebuilt = InterpolateCubic(scales[previous], scales[first], scales[second], scales[next],
+                                                 t, firstWeight, secondWeight);
+            return GetToleranceRatio(glm::length(rebuilt - scales[keyIndex]) * scaleReach, positionTolerance);
+        }, kept);
+        AddFittedTrack(fitted, fitted->scaleTracks, fitted->scales, scaleTimes, scales, kept,
+                       linear, linear.scaleTracks[trackIndex], linear.scales);
+    }
+}
@@ -0,0 +1,335 @@
+// cooked files are what the importers leave next to a source asset so later
+// runs can skip the import. A cooked file is a header followed by a stream
+// of arrays, each a u64 count and the raw elements aligned to
+// COOKED_ALIGNMENT, read back in the order they were written. The stream
+// starts with the paths of the source files the asset was cooked from
+#define COOKED_ALIGNMENT 16
+
+struct CookedHeader
+{
+    u32 magic;
+    u32 version;    // bumped whenever anything written to the stream changes
+    u64 size;        // of the whole file, a cut off write fails to load
+    u64 sourceStamp; // of the sizes and write times of the sources, checked first
+    u64 sourceHash;  // of the contents of the sources, only read when the stamp differs
+    u64 importHash;  // of everything else the cooked data depends on
+};
+
+struct MappedFile
+{
+    const u8 *data;
+    u64 size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// read only view of a whole file, false if it does not exist or is empty
+b8 MapFile(const char *path, MappedFile *mapped)
+{
+    *mapped = {};
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    HANDLE mapping = 0;
+    if(GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    }
+    const void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if(!data)
+    {
+        if(mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    mapped->file = file;
+    mapped->mapping = mapping;
+    mapped->size = (u64)size.QuadPart;
+#else
+    i32 file = open(path, O_RDONLY);
+    if(file < 0) return false;
+    struct stat info;
+    void *data = MAP_FAILED;
+    if(fstat(file, &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if(data == MAP_FAILED) return false;
+    mapped->size = (u64)info.st_size;
+#endif
+    mapped->data = (const u8 *)data;
+    return true;
+}
+
+void UnmapFile(MappedFile *mapped)
+{
+    if(!mapped->data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped->data);
+    CloseHandle(mapped->mapping);
+    CloseHandle(mapped->file);
+#else
+    munmap((void *)mapped->data, (size_t)mapped->size);
+#endif
+    *mapped = {};
+}
+
+#define HASH_SEED 14695981039346656037ULL
+
+// FNV-1a, chained through hash so several inputs make one hash
+inline u64 HashBytes(const void *data, u64 size, u64 hash = HASH_SEED)
+{
+    const u8 *bytes = (const u8 *)data;
+    for(u64 i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+template<typename T>
+inline u64 HashValue(const T &value, u64 hash)
+{
+    return HashBytes(&value, sizeof(T), hash);
+}
+
+// false if the file cannot be read
+b8 HashFile(const char *path, u64 *hash)
+{
+    MappedFile mapped;
+    if(!MapFile(path, &mapped)) return false;
+    *hash = HashBytes(mapped.data, mapped.size, *hash);
+    UnmapFile(&mapped);
+    return true;
+}
+
+// size and last write time of the file without reading it, false if it does
+// not exist. A missing file still changes the hash, so creating it later
+// makes the stamp differ
+b8 StampFile(const char *path, u64 *hash)
+{
+    u64 size = 0;
+    u64 writeTime = 0;
+    b8 exists = false;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if(GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+    {
+        size = ((u64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+        writeTime = ((u64)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+        exists = true;
+    }
+#else
+    struct stat info;
+    if(stat(path, &info) == 0)
+    {
+        size = (u64)info.st_size;
+        writeTime = (u64)info.st_mtime;
+        exists = true;
+    }
+#endif
+    *hash = HashValue(exists, *hash);
+    *hash = HashValue(size, *hash);
+    *hash = HashValue(writeTime, *hash);
+    return exists;
+}
+
+inline b8 FileExists(const char *path)
+{
+    u64 stamp = HASH_SEED;
+    return StampFile(path, &stamp);
+}
+
+u64 StampFiles(const std::vector<std::string> &paths)
+{
+    u64 hash = HASH_SEED;
+    for(const std::string &path : paths) StampFile(path.c_str(), &hash);
+    return hash;
+}
+
+// missing and empty files hash the same, the stamp tells them apart
+u64 HashFiles(const std::vector<std::string> &paths)
+{
+    u64 hash = HASH_SEED;
+    for(const std::string &path : paths)
+    {
+        b8 read = HashFile(path.c_str(), &hash);
+        hash = HashValue(read, hash);
+    }
+    return hash;
+}
+
+struct CookedWriter
+{
+    std::vector<u8> bytes;
+};
+
+template<typename T>
+void WriteCookedArray(CookedWriter *writer, const T *values, u64 count)
+{
+    std::vector<u8> &bytes = writer->bytes;
+    bytes.insert(bytes.end(), (const u8 *)&count, (const u8 *)(&count + 1));
+    bytes.resize((bytes.size() + COOKED_ALIGNMENT - 1) & ~(u64)(COOKED_ALIGNMENT - 1));
+    if(count) bytes.insert(bytes.end(), (const u8 *)values, (const u8 *)(values + count));
+}
+
+template<typename T>
+inline void WriteCookedVector(CookedWriter *writer, const std::vector<T> &values)
+{
+    WriteCookedArray(writer, values.data(), values.size());
+}
+
+template<typename T>
+inline void WriteCookedValue(CookedWriter *writer, const T &value)
+{
+    WriteCookedArray(writer, &value, 1);
+}
+
+inline void WriteCookedString(CookedWriter *writer, const std::string &value)
+{
+    WriteCookedArray(writer, value.data(), value.size());
+}
+
+// stamps and hashes the sources as they are now, so call it once the import
+// that read them is done
+void BeginCookedFile(CookedWriter *writer, u32 magic, u32 version, const std::vector<std::string> &sources, u64 importHash)
+{
+    CookedHeader header = {};
+    header.magic = magic;
+    header.version = version;
+    header.sourceStamp = StampFiles(sources);
+    header.sourceHash = HashFiles(sources);
+    header.importHash = importHash;
+    writer->bytes.assign((const u8 *)&header, (const u8 *)(&header + 1));
+    WriteCookedValue(writer, (i32)sources.size());
+    for(const std::string &source : sources) WriteCookedString(writer, source);
+}
+
+// fills in the size of the header and writes the file in one go
+b8 SaveCookedFile(CookedWriter *writer, const char *path)
+{
+    ((CookedHeader *)writer->bytes.data())->size = writer->bytes.size();
+    FILE *file = 0;
+#ifdef _WIN32
+    fopen_s(&file, path, "wb");
+#else
+    file = fopen(path, "wb");
+#endif
+    if(!file) return false;
+    size_t written = fwrite(writer->bytes.data(), 1, writer->bytes.size(), file);
+    fclose(file);
+    return written == writer->bytes.size();
+}
+
+// reads a cooked file in place, every read after the first failure fails
+struct CookedReader
+{
+    const u8 *base;
+    u64 at;
+    u64 size;
+    b8 failed;
+    b8 restamp;      // the sources were touched but not changed
+    u64 sourceStamp; // their stamp now
+};
+
+// points into the mapped file, null with a count of 0 for empty arrays
+template<typename T>
+const T *ReadCookedArray(CookedReader *reader, u64 *count)
+{
+    *count = 0;
+    if(reader->failed || reader->at + sizeof(u64) > reader->size)
+    {
+        reader->failed = true;
+        return 0;
+    }
+    u64 arrayCount;
+    memcpy(&arrayCount, reader->base + reader->at, sizeof(u64));
+    u64 at = (reader->at + sizeof(u64) + COOKED_ALIGNMENT - 1) & ~(u64)(COOKED_ALIGNMENT - 1);
+    if(at > reader->size || arrayCount > (reader->size - at) / sizeof(T))
+    {
+        reader->failed = true;
+        return 0;
+    }
+    reader->at = at + arrayCount * sizeof(T);
+    *count = arrayCount;
+    return arrayCount ? (const T *)(reader->base + at) : 0;
+}
+
+// one allocation for the whole array
+template<typename T>
+inline void ReadCookedVector(CookedReader *reader, std::vector<T> &values)
+{
+    u64 count;
+    const T *data = ReadCookedArray<T>(reader, &count);
+    values.assign(data, data + count);
+}
+
+template<typename T>
+inline void ReadCookedValue(CookedReader *reader, T *value)
+{
+    u64 count;
+    const T *data = ReadCookedArray<T>(reader, &count);
+    if(1 == count) memcpy(value, data, sizeof(T));
+    else reader->failed = true;
+}
+
+inline void ReadCookedString(CookedReader *reader, std::string &value)
+{
+    u64 count;
+    const char *data = ReadCookedArray<char>(reader, &count);
+    value.assign(data ? data : "", (size_t)count);
+}
+
+// false if the file is not a cooked file of that kind and version, or was
+// cooked from other sources or with other import settings. The contents of
+// the sources are only hashed when their sizes or write times changed
+b8 BeginCookedRead(CookedReader *reader, const MappedFile &mapped, u32 magic, u32 version, u64 importHash)
+{
+    *reader = {};
+    if(mapped.size < sizeof(CookedHeader)) return false;
+    CookedHeader header;
+    memcpy(&header, mapped.data, sizeof(header));
+    if(header.magic != magic || header.version != version || header.size != mapped.size ||
+       header.importHash != importHash)
+    {
+        return false;
+    }
+    reader->base = mapped.data;
+    reader->at = sizeof(CookedHeader);
+    reader->size = mapped.size;
+
+    // every path takes at least its count
+    i32 sourceCount = 0;
+    ReadCookedValue(reader, &sourceCount);
+    if(sourceCount < 0 || (u64)sourceCount > (reader->size - reader->at) / sizeof(u64)) return false;
+    std::vector<std::string> sources(reader->failed ? 0 : sourceCount);
+    for(std::string &source : sources) ReadCookedString(reader, source);
+    if(reader->failed) return false;
+
+    reader->sourceStamp = StampFiles(sources);
+    if(reader->sourceStamp == header.sourceStamp) return true;
+    if(HashFiles(sources) != header.sourceHash) return false;
+    reader->restamp = true;
+    return true;
+}
+
+// takes the new stamp of sources that were touched but not changed, so the
+// next load skips the hash again. Call it once the file is unmapped
+void RestampCookedFile(const CookedReader &reader, const char *path)
+{
+    if(!reader.restamp) return;
+    FILE *file = 0;
+#ifdef _WIN32
+    fopen_s(&file, path, "r+b");
+#else
+    file = fopen(path, "r+b");
+#endif
+    if(!file) return;
+    fseek(file, (long)offsetof(CookedHeader, sourceStamp), SEEK_SET);
+    fwrite(&reader.sourceStamp, sizeof(u64), 1, file);
+    fclose(file);
+}
@@ -0,0 +1,579 @@
+// Lanes of the batch pose sampler, float and quantized keys. sampler.cpp
+// includes this file twice, into the namespaces avx2 with SAMPLER_AVX2 set
+// and sse2 without it, and picks one at run time. Nothing in here may
+// include a header.
+
+#if SAMPLER_AVX2
+
+#define SAMPLER_LANES 8
+
+typedef __m256 lane_f32;
+
+inline lane_f32 LaneSet1(f32 value) { return _mm256_set1_ps(value); }
+inline lane_f32 LaneLoad(const f32 *values) { return _mm256_loadu_ps(values); }
+inline lane_f32 LaneAdd(lane_f32 a, lane_f32 b) { return _mm256_add_ps(a, b); }
+inline lane_f32 LaneSub(lane_f32 a, lane_f32 b) { return _mm256_sub_ps(a, b); }
+inline lane_f32 LaneMul(lane_f32 a, lane_f32 b) { return _mm256_mul_ps(a, b); }
+inline lane_f32 LaneDiv(lane_f32 a, lane_f32 b) { return _mm256_div_ps(a, b); }
+inline lane_f32 LaneSqrt(lane_f32 a) { return _mm256_sqrt_ps(a); }
+inline lane_f32 LaneXor(lane_f32 a, lane_f32 b) { return _mm256_xor_ps(a, b); }
+inline lane_f32 LaneAnd(lane_f32 a, lane_f32 b) { return _mm256_and_ps(a, b); }
+inline lane_f32 LaneMax(lane_f32 a, lane_f32 b) { return _mm256_max_ps(a, b); }
+inline lane_f32 LaneOr(lane_f32 a, lane_f32 b) { return _mm256_or_ps(a, b); }
+inline lane_f32 LaneAndNot(lane_f32 a, lane_f32 b) { return _mm256_andnot_ps(a, b); }
+inline lane_f32 LaneLessThan(lane_f32 a, lane_f32 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline lane_f32 LaneEqual(lane_f32 a, lane_f32 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+
+// base[indices[lane]] for every lane
+inline lane_f32 LaneGather(const f32 *base, const i32 *indices)
+{
+    __m256i offsets = _mm256_loadu_si256((const __m256i *)indices);
+    return _mm256_i32gather_ps(base, offsets, 4);
+}
+
+#else
+
+#define SAMPLER_LANES 4
+
+typedef __m128 lane_f32;
+
+inline lane_f32 LaneSet1(f32 value) { return _mm_set1_ps(value); }
+inline lane_f32 LaneLoad(const f32 *values) { return _mm_loadu_ps(values); }
+inline lane_f32 LaneAdd(lane_f32 a, lane_f32 b) { return _mm_add_ps(a, b); }
+inline lane_f32 LaneSub(lane_f32 a, lane_f32 b) { return _mm_sub_ps(a, b); }
+inline lane_f32 LaneMul(lane_f32 a, lane_f32 b) { return _mm_mul_ps(a, b); }
+inline lane_f32 LaneDiv(lane_f32 a, lane_f32 b) { return _mm_div_ps(a, b); }
+inline lane_f32 LaneSqrt(lane_f32 a) { return _mm_sqrt_ps(a); }
+inline lane_f32 LaneXor(lane_f32 a, lane_f32 b) { return _mm_xor_ps(a, b); }
+inline lane_f32 LaneAnd(lane_f32 a, lane_f32 b) { return _mm_and_ps(a, b); }
+inline lane_f32 LaneMax(lane_f32 a, lane_f32 b) { return _mm_max_ps(a, b); }
+inline lane_f32 LaneOr(lane_f32 a, lane_f32 b) { return _mm_or_ps(a, b); }
+inline lane_f32 LaneAndNot(lane_f32 a, lane_f32 b) { return _mm_andnot_ps(a, b); }
+inline lane_f32 LaneLessThan(lane_f32 a, lane_f32 b) { return _mm_cmplt_ps(a, b); }
+inline lane_f32 LaneEqual(lane_f32 a, lane_f32 b) { return _mm_cmpeq_ps(a, b); }
+
+inline lane_f32 LaneGather(const f32 *base, const i32 *indices)
+{
+    return _mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]]);
+}
+
+#endif
+
+// mask ? a : b
+inline lane_f32 LaneSelect(lane_f32 mask, lane_f32 a, lane_f32 b)
+{
+    return LaneOr(LaneAnd(mask, a), LaneAndNot(mask, b));
+}
+
+inline lane_f32 LaneLerp(lane_f32 a, lane_f32 b, lane_f32 t)
+{
+    return LaneAdd(a, LaneMul(LaneSub(b, a), t));
+}
+
+// segment of every lane, in floats from the start of the key block. Only
+// cubic tracks fill in the neighbours and the tangent weights
+struct SamplerBatch
+{
+    i32 first[SAMPLER_LANES];
+    i32 second[SAMPLER_LANES];
+    f32 scaleFactor[SAMPLER_LANES];
+    i32 previous[SAMPLER_LANES];
+    i32 next[SAMPLER_LANES];
+    f32 firstWeight[SAMPLER_LANES];
+    f32 secondWeight[SAMPLER_LANES];
+};
+
+template<TrackKind Kind>
+inline void SetBatchLane(SamplerBatch &batch, i32 lane, const AnimationKeys &keys, const AnimationTrack &track,
+                         i32 components, const TimelineCursor &cursor)
+{
+    i32 keyIndex, nextIndex;
+    GetKindSegment<Kind>(cursor, &keyIndex, &nextIndex, &batch.scaleFactor[lane]);
+    batch.first[lane] = (track.keyOffset + keyIndex) * components;
+    batch.second[lane] = (track.keyOffset + nextIndex) * components;
+    if(TRACK_KIND_CUBIC == Kind)
+    {
+        i32 previous, next;
+        GetCubicNeighbours(keys, track, keyIndex, &previous, &next, &batch.firstWeight[lane], &batch.secondWeight[lane]);
+        batch.previous[lane] = (track.keyOffset + previous) * components;
+        batch.next[lane] = (track.keyOffset + next) * components;
+    }
+}
+
+// one component type in lanes, vec3 for positions and scales and quat for
+// rotations. glm::quat is stored x, y, z, w
+template<typename Value> struct LaneValue;
+
+template<> struct LaneValue<glm::vec3>
+{
+    lane_f32 x, y, z;
+};
+
+template<> struct LaneValue<glm::quat>
+{
+    lane_f32 x, y, z, w;
+};
+
+inline void GatherLanes(const f32 *values, const i32 *indices, LaneValue<glm::vec3> *result)
+{
+    result->x = LaneGather(values + 0, indices);
+    result->y = LaneGather(values + 1, indices);
+    result->z = LaneGather(values + 2, indices);
+}
+
+inline void GatherLanes(const f32 *values, const i32 *indices, LaneValue<glm::quat> *result)
+{
+    result->x = LaneGather(values + 0, indices);
+    result->y = LaneGather(values + 1, indices);
+    result->z = LaneGather(values + 2, indices);
+    result->w = LaneGather(values + 3, indices);
+}
+
+// nlerp between two rotations per lane
+inline void NlerpLanes(lane_f32 x0, lane_f32 y0, lane_f32 z0, lane_f32 w0,
+                       lane_f32 x1, lane_f32 y1, lane_f32 z1, lane_f32 w1, lane_f32 t,
+                       lane_f32 *x, lane_f32 *y, lane_f32 *z, lane_f32 *w)
+{
+    // take the short way around, flip the second key if the dot is negative
+    lane_f32 dot = LaneAdd(LaneAdd(LaneMul(x0, x1), LaneMul(y0, y1)), LaneAdd(LaneMul(z0, z1), LaneMul(w0, w1)));
+    lane_f32 sign = LaneAnd(LaneLessThan(dot, LaneSet1(0.0f)), LaneSet1(-0.0f));
+    x1 = LaneXor(x1, sign);
+    y1 = LaneXor(y1, sign);
+    z1 = LaneXor(z1, sign);
+    w1 = LaneXor(w1, sign);
+
+    lane_f32 rx = LaneLerp(x0, x1, t);
+    lane_f32 ry = LaneLerp(y0, y1, t);
+    lane_f32 rz = LaneLerp(z0, z1, t);
+    lane_f32 rw = LaneLerp(w0, w1, t);
+    lane_f32 lengthSquared = LaneAdd(LaneAdd(LaneMul(rx, rx), LaneMul(ry, ry)), LaneAdd(LaneMul(rz, rz), LaneMul(rw, rw)));
+    lane_f32 inverseLength = LaneDiv(LaneSet1(1.0f), LaneSqrt(lengthSquared));
+    *x = LaneMul(rx, inverseLength);
+    *y = LaneMul(ry, inverseLength);
+    *z = LaneMul(rz, inverseLength);
+    *w = LaneMul(rw, inverseLength);
+}
+
+inline void InterpolateLanes(const LaneValue<glm::vec3> &a, const LaneValue<glm::vec3> &b, lane_f32 t,
+                             LaneValue<glm::vec3> *result)
+{
+    result->x = LaneLerp(a.x, b.x, t);
+    result->y = LaneLerp(a.y, b.y, t);
+    result->z = LaneLerp(a.z, b.z, t);
+}
+
+inline void InterpolateLanes(const LaneValue<glm::quat> &a, const LaneValue<glm::quat> &b, lane_f32 t,
+                             LaneValue<glm::quat> *result)
+{
+    NlerpLanes(a.x, a.y, a.z, a.w, b.x, b.y, b.z, b.w, t, &result->x, &result->y, &result->z, &result->w);
+}
+
+// Hermite basis of a batch, the tangent terms already carry the weights of
+// every lane
+struct CubicBasis
+{
+    lane_f32 first;
+    lane_f32 firstTangent;
+    lane_f32 second;
+    lane_f32 secondTangent;
+};
+
+inline CubicBasis GetCubicBasis(lane_f32 t, lane_f32 firstWeight, lane_f32 secondWeight)
+{
+    lane_f32 t2 = LaneMul(t, t);
+    lane_f32 t3 = LaneMul(t2, t);
+    lane_f32 two = LaneSet1(2.0f);
+    lane_f32 three = LaneSet1(3.0f);
+    CubicBasis basis;
+    basis.second = LaneSub(LaneMul(three, t2), LaneMul(two, t3));
+    basis.first = LaneSub(LaneSet1(1.0f), basis.second);
+    basis.firstTangent = LaneMul(LaneAdd(LaneSub(t3, LaneMul(two, t2)), t), firstWeight);
+    basis.secondTangent = LaneMul(LaneSub(t3, t2), secondWeight);
+    return basis;
+}
+
+inline lane_f32 CubicLane(const CubicBasis &basis, lane_f32 previous, lane_f32 first, lane_f32 second, lane_f32 next)
+{
+    lane_f32 result = LaneAdd(LaneMul(basis.first, first), LaneMul(basis.second, second));
+    result = LaneAdd(result, LaneMul(basis.firstTangent, LaneSub(second, previous)));
+    return LaneAdd(result, LaneMul(basis.secondTangent, LaneSub(next, first)));
+}
+
+// flips every lane of value whose dot with reference is negative
+inline void AlignRotationLanes(const LaneValue<glm::quat> &reference, LaneValue<glm::quat> *value)
+{
+    lane_f32 dot = LaneAdd(LaneAdd(LaneMul(reference.x, value->x), LaneMul(reference.y, value->y)),
+                           LaneAdd(LaneMul(reference.z, value->z), LaneMul(reference.w, value->w)));
+    lane_f32 sign = LaneAnd(LaneLessThan(dot, LaneSet1(0.0f)), LaneSet1(-0.0f));
+    value->x = LaneXor(value->x, sign);
+    value->y = LaneXor(value->y, sign);
+    value->z = LaneXor(value->z, sign);
+    value->w = LaneXor(value->w, sign);
+}
+
+inline void InterpolateCubicLanes(const LaneValue<glm::vec3> &previous, const LaneValue<glm::vec3> &first,
+                                  const LaneValue<glm::vec3> &second, const LaneValue<glm::vec3> &next,
+                                  const CubicBasis &basis, LaneValue<glm::vec3> *result)
+{
+    result->x = CubicLane(basis, previous.x, first.x, second.x, next.x);
+    result->y = CubicLane(basis, previous.y, first.y, second.y, next.y);
+    result->z = CubicLane(basis, previous.z, first.z, second.z, next.z);
+}
+
+// same as InterpolateCubic for rotations, the neighbours are moved to the
+// hemisphere of the segment and the curve is normalized
+inline void InterpolateCubicLanes(LaneValue<glm::quat> previous, const LaneValue<glm::quat> &first,
+                                  LaneValue<glm::quat> second, LaneValue<glm::quat> next,
+                                  const CubicBasis &basis, LaneValue<glm::quat> *result)
+{
+    AlignRotationLanes(first, &second);
+    AlignRotationLanes(first, &previous);
+    AlignRotationLanes(second, &next);
+    lane_f32 x = CubicLane(basis, previous.x, first.x, second.x, next.x);
+    lane_f32 y = CubicLane(basis, previous.y, first.y, second.y, next.y);
+    lane_f32 z = CubicLane(basis, previous.z, first.z, second.z, next.z);
+    lane_f32 w = CubicLane(basis, previous.w, first.w, second.w, next.w);
+    lane_f32 lengthSquared = LaneAdd(LaneAdd(LaneMul(x, x), LaneMul(y, y)), LaneAdd(LaneMul(z, z), LaneMul(w, w)));
+    lane_f32 inverseLength = LaneDiv(LaneSet1(1.0f), LaneSqrt(lengthSquared));
+    result->x = LaneMul(x, inverseLength);
+    result->y = LaneMul(y, inverseLength);
+    result->z = LaneMul(z, inverseLength);
+    result->w = LaneMul(w, inverseLength);
+}
+
+inline glm::vec3 GetLane(const LaneValue<glm::vec3> &value, i32 lane)
+{
+    return glm::vec3(M(value.x, lane), M(value.y, lane), M(value.z, lane));
+}
+
+inline glm::quat GetLane(const LaneValue<glm::quat> &value, i32 lane)
+{
+    return glm::quat(M(value.w, lane), M(value.x, lane), M(value.y, lane), M(value.z, lane));
+}
+
+// a stepped track is only read at its held key, a cubic one reads the
+// neighbours of its segment too, every other kind interpolates between the
+// two keys of its segment
+template<TrackKind Kind, typename Value>
+inline void SampleLanes(const f32 *values, const SamplerBatch &batch, LaneValue<Value> *result)
+{
+    if(TRACK_KIND_STEPPED == Kind)
+    {
+        GatherLanes(values, batch.first, result);
+        return;
+    }
+    LaneValue<Value> first, second;
+    GatherLanes(values, batch.first, &first);
+    GatherLanes(values, batch.second, &second);
+    if(TRACK_KIND_CUBIC == Kind)
+    {
+        LaneValue<Value> previous, next;
+        GatherLanes(values, batch.previous, &previous);
+        GatherLanes(values, batch.next, &next);
+        CubicBasis basis = GetCubicBasis(LaneLoad(batch.scaleFactor), LaneLoad(batch.firstWeight), LaneLoad(batch.secondWeight));
+        InterpolateCubicLanes(previous, first, second, next, basis, result);
+        return;
+    }
+    InterpolateLanes(first, second, LaneLoad(batch.scaleFactor), result);
+}
+
+// tracks of the next batch, the lanes past the end repeat the last track and
+// are not written back. Returns the number of lanes in use
+inline i32 GetBatchTracks(const std::vector<i32> &tracks, i32 first, i32 *batchTracks)
+{
+    i32 laneCount = (i32)tracks.size() - first;
+    if(laneCount > SAMPLER_LANES) laneCount = SAMPLER_LANES;
+    for(i32 lane = 0; lane < SAMPLER_LANES; ++lane)
+    {
+        batchTracks[lane] = tracks[first + (lane < laneCount ? lane : laneCount - 1)];
+    }
+    return laneCount;
+}
+
+// one homogeneous batch, every track in it has the same kind and component
+// type so the loop has no branch on either
+template<TrackKind Kind, typename Value>
+internal void SampleTracks(const AnimationKeys &keys, const std::vector<i32> &kindTracks,
+                           const std::vector<AnimationTrack> &tracks, const std::vector<Value> &values,
+                           const TimelineCursor *cursors, BoneTransform *localTransforms, Value BoneTransform::*result)
+{
+    const i32 components = sizeof(Value) / sizeof(f32);
+    const f32 *keyValues = (const f32 *)values.data();
+    for(i32 first = 0; first < (i32)kindTracks.size(); first += SAMPLER_LANES)
+    {
+        i32 batchTracks[SAMPLER_LANES];
+        i32 laneCount = GetBatchTracks(kindTracks, first, batchTracks);
+
+        SamplerBatch batch;
+        for(i32 lane = 0; lane < SAMPLER_LANES; ++lane)
+        {
+            const AnimationTrack &track = tracks[batchTracks[lane]];
+            SetBatchLane<Kind>(batch, lane, keys, track, components, cursors[track.timeline]);
+        }
+
+        LaneValue<Value> sample;
+        SampleLanes<Kind>(keyValues, batch, &sample);
+        for(i32 lane = 0; lane < laneCount; ++lane)
+        {
+            localTransforms[batchTracks[lane]].*result = GetLane(sample, lane);
+        }
+    }
+}
+
+template<typename Value>
+internal void SampleTrackBatches(const AnimationKeys &keys, const TrackBatches &batches,
+                                 const std::vector<AnimationTrack> &tracks, const std::vector<Value> &values,
+                                 const TimelineCursor *cursors, BoneTransform *localTransforms, Value BoneTransform::*result)
+{
+    SampleTracks<TRACK_KIND_LINEAR_UNIFORM>(keys, batches.tracks[TRACK_KIND_LINEAR_UNIFORM], tracks, values,
+                                            cursors, localTransforms, result);
+    SampleTracks<TRACK_KIND_LINEAR_VARIABLE>(keys, batches.tracks[TRACK_KIND_LINEAR_VARIABLE], tracks, values,
+                                             cursors, localTransforms, result);
+    SampleTracks<TRACK_KIND_STEPPED>(keys, batches.tracks[TRACK_KIND_STEPPED], tracks, values,
+                                     cursors, localTransforms, result);
+    SampleTracks<TRACK_KIND_CUBIC>(keys, batches.tracks[TRACK_KIND_CUBIC], tracks, values,
+                                   cursors, localTransforms, result);
+}
+
+// samples the animated tracks of the clip SAMPLER_LANES tracks at a time, one
+// batch per kind and component, after one key search per timeline. Constant
+// tracks are never touched, WriteConstantTracks puts them in the pose once
+void SamplePoseBatched(const AnimationKeys &keys, f32 animationTime,
+                       TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    SampleTimelines(keys, animationTime, cursors);
+    SampleTrackBatches(keys, keys.positionBatches, keys.positionTracks, keys.positions,
+                       cursors, localTransforms, &BoneTransform::translation);
+    SampleTrackBatches(keys, keys.rotationBatches, keys.rotationTracks, keys.rotations,
+                       cursors, localTransforms, &BoneTransform::rotation);
+    SampleTrackBatches(keys, keys.scaleBatches, keys.scaleTracks, keys.scales,
+                       cursors, localTransforms, &BoneTransform::scale);
+}
+
+// quantized keys of a batch of lanes, one row per component. The integers
+// are only unpacked and widened here, dequantizing runs in lanes. Rotation
+// rows 0 to 2 hold the smallest three and row 3 the dropped index. The
+// neighbours and tangent weights are only filled in for cubic tracks
+struct QuantizedBatch
+{
+    f32 first[4][SAMPLER_LANES];
+    f32 second[4][SAMPLER_LANES];
+    f32 minimum[3][SAMPLER_LANES];
+    f32 step[3][SAMPLER_LANES];
+    f32 scaleFactor[SAMPLER_LANES];
+    f32 previous[4][SAMPLER_LANES];
+    f32 next[4][SAMPLER_LANES];
+    f32 firstWeight[SAMPLER_LANES];
+    f32 secondWeight[SAMPLER_LANES];
+};
+
+inline void SetQuantizedVec3Key(f32 (*rows)[SAMPLER_LANES], i32 lane, const u16 *values, i32 keyIndex)
+{
+    for(i32 component = 0; component < 3; ++component)
+    {
+        rows[component][lane] = (f32)values[keyIndex * 3 + component];
+    }
+}
+
+inline void SetQuantizedVec3Lane(QuantizedBatch &batch, i32 lane, const u16 *values, const QuantizedRange &range,
+                                 i32 firstKey, i32 secondKey)
+{
+    SetQuantizedVec3Key(batch.first, lane, values, firstKey);
+    SetQuantizedVec3Key(batch.second, lane, values, secondKey);
+    for(i32 component = 0; component < 3; ++component)
+    {
+        batch.minimum[component][lane] = range.minimum[component];
+        batch.step[component][lane] = range.step[component];
+    }
+}
+
+// keys on either side of the segment of a cubic track, relative to the
+// first key of the track
+inline void SetCubicNeighbourKeys(QuantizedBatch &batch, i32 lane, const AnimationKeys &keys, const AnimationTrack &track,
+                                  i32 keyIndex, i32 *previous, i32 *next)
+{
+    GetCubicNeighbours(keys, track, keyIndex, previous, next, &batch.firstWeight[lane], &batch.secondWeight[lane]);
+    *previous += track.keyOffset;
+    *next += track.keyOffset;
+}
+
+inline void SetQuantizedRotationKey(f32 (*rows)[SAMPLER_LANES], i32 lane, const QuantizedKeys &quantized, i32 keyIndex)
+{
+    u32 largest, components[3];
+    UnpackRotation(quantized, keyIndex, &largest, components);
+    rows[0][lane] = (f32)components[0];
+    rows[1][lane] = (f32)components[1];
+    rows[2][lane] = (f32)components[2];
+    rows[3][lane] = (f32)largest;
+}
+
+// both keys share the range of the track, so the quantized values are
+// interpolated first and dequantized once
+inline void SampleQuantizedVec3Lanes(const QuantizedBatch &batch, lane_f32 *x, lane_f32 *y, lane_f32 *z)
+{
+    lane_f32 t = LaneLoad(batch.scaleFactor);
+    lane_f32 *results[3] = { x, y, z };
+    for(i32 component = 0; component < 3; ++component)
+    {
+        lane_f32 value = LaneLerp(LaneLoad(batch.first[component]), LaneLoad(batch.second[component]), t);
+        *results[component] = LaneAdd(LaneLoad(batch.minimum[component]), LaneMul(LaneLoad(batch.step[component]), value));
+    }
+}
+
+// the Hermite curve is a weighted sum of the keys whose weights add up to
+// one, so like the lerp it runs on the quantized values
+inline void SampleQuantizedCubicLanes(const QuantizedBatch &batch, lane_f32 *x, lane_f32 *y, lane_f32 *z)
+{
+    CubicBasis basis = GetCubicBasis(LaneLoad(batch.scaleFactor), LaneLoad(batch.firstWeight), LaneLoad(batch.secondWeight));
+    lane_f32 *results[3] = { x, y, z };
+    for(i32 component = 0; component < 3; ++component)
+    {
+        lane_f32 value = CubicLane(basis, LaneLoad(batch.previous[component]), LaneLoad(batch.first[component]),
+                                   LaneLoad(batch.second[component]), LaneLoad(batch.next[component]));
+        *results[component] = LaneAdd(LaneLoad(batch.minimum[component]), LaneMul(LaneLoad(batch.step[component]), value));
+    }
+}
+
+inline void DecodeSmallestThreeLanes(const f32 (*rows)[SAMPLER_LANES], f32 maxValue,
+                                     lane_f32 *x, lane_f32 *y, lane_f32 *z, lane_f32 *w)
+{
+    lane_f32 scale = LaneSet1(2.0f * SMALLEST_THREE_BOUND / maxValue);
+    lane_f32 bound = LaneSet1(SMALLEST_THREE_BOUND);
+    lane_f32 a = LaneSub(LaneMul(LaneLoad(rows[0]), scale), bound);
+    lane_f32 b = LaneSub(LaneMul(LaneLoad(rows[1]), scale), bound);
+    lane_f32 c = LaneSub(LaneMul(LaneLoad(rows[2]), scale), bound);
+    lane_f32 lengthSquared = LaneAdd(LaneAdd(LaneMul(a, a), LaneMul(b, b)), LaneMul(c, c));
+    lane_f32 d = LaneSqrt(LaneMax(LaneSub(LaneSet1(1.0f), lengthSquared), LaneSet1(0.0f)));
+
+    // put the rebuilt component back where it was dropped
+    lane_f32 largest = LaneLoad(rows[3]);
+    lane_f32 isX = LaneEqual(largest, LaneSet1(0.0f));
+    lane_f32 isY = LaneEqual(largest, LaneSet1(1.0f));
+    lane_f32 isZ = LaneEqual(largest, LaneSet1(2.0f));
+    lane_f32 isW = LaneEqual(largest, LaneSet1(3.0f));
+    *x = LaneSelect(isX, d, a);
+    *y = LaneSelect(isX, a, LaneSelect(isY, d, b));
+    *z = LaneSelect(isZ, d, LaneSelect(isW, c, b));
+    *w = LaneSelect(isW, d, c);
+}
+
+template<TrackKind Kind>
+internal void SampleQuantizedVec3Tracks(const AnimationKeys &keys, const std::vector<i32> &kindTracks,
+                                        const std::vector<AnimationTrack> &tracks, const u16 *values,
+                                        const std::vector<QuantizedRange> &ranges, const TimelineCursor *cursors,
+                                        BoneTransform *localTransforms, glm::vec3 BoneTransform::*result)
+{
+    for(i32 firstTrack = 0; firstTrack < (i32)kindTracks.size(); firstTrack += SAMPLER_LANES)
+    {
+        i32 batchTracks[SAMPLER_LANES];
+        i32 laneCount = GetBatchTracks(kindTracks, firstTrack, batchTracks);
+
+        QuantizedBatch batch;
+        for(i32 lane = 0; lane < SAMPLER_LANES; ++lane)
+        {
+            i32 trackIndex = batchTracks[lane];
+            const AnimationTrack &track = tracks[trackIndex];
+            i32 first, second;
+            GetKindSegment<Kind>(cursors[track.timeline], &first, &second, &batch.scaleFactor[lane]);
+            SetQuantizedVec3Lane(batch, lane, values, ranges[trackIndex], track.keyOffset + first, track.keyOffset + second);
+            if(TRACK_KIND_CUBIC == Kind)
+            {
+                i32 previous, next;
+                SetCubicNeighbourKeys(batch, lane, keys, track, first, &previous, &next);
+                SetQuantizedVec3Key(batch.previous, lane, values, previous);
+                SetQuantizedVec3Key(batch.next, lane, values, next);
+            }
+        }
+
+        lane_f32 x, y, z;
+        if(TRACK_KIND_CUBIC == Kind)
+            SampleQuantizedCubicLanes(batch, &x, &y, &z);
+        else
+            SampleQuantizedVec3Lanes(batch, &x, &y, &z);
+        for(i32 lane = 0; lane < laneCount; ++lane)
+        {
+            localTransforms[batchTracks[lane]].*result = glm::vec3(M(x, lane), M(y, lane), M(z, lane));
+        }
+    }
+}
+
+template<TrackKind Kind>
+internal void SampleQuantizedRotationTracks(const AnimationKeys &keys, const QuantizedKeys &quantized,
+                                            const TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    const std::vector<i32> &kindTracks = keys.rotationBatches.tracks[Kind];
+    f32 maxValue = GetRotationMaxValue(quantized);
+    for(i32 firstTrack = 0; firstTrack < (i32)kindTracks.size(); firstTrack += SAMPLER_LANES)
+    {
+        i32 batchTracks[SAMPLER_LANES];
+        i32 laneCount = GetBatchTracks(kindTracks, firstTrack, batchTracks);
+
+        QuantizedBatch batch;
+        for(i32 lane = 0; lane < SAMPLER_LANES; ++lane)
+        {
+            i32 trackIndex = batchTracks[lane];
+            const AnimationTrack &track = keys.rotationTracks[trackIndex];
+            i32 first, second;
+            GetKindSegment<Kind>(cursors[track.timeline], &first, &second, &batch.scaleFactor[lane]);
+            SetQuantizedRotationKey(batch.first, lane, quantized, track.keyOffset + first);
+            SetQuantizedRotationKey(batch.second, lane, quantized, track.keyOffset + second);
+            if(TRACK_KIND_CUBIC == Kind)
+            {
+                i32 previous, next;
+                SetCubicNeighbourKeys(batch, lane, keys, track, first, &previous, &next);
+                SetQuantizedRotationKey(batch.previous, lane, quantized, previous);
+                SetQuantizedRotationKey(batch.next, lane, quantized, next);
+            }
+        }
+
+        LaneValue<glm::quat> first, second, result;
+        DecodeSmallestThreeLanes(batch.first, maxValue, &first.x, &first.y, &first.z, &first.w);
+        DecodeSmallestThreeLanes(batch.second, maxValue, &second.x, &second.y, &second.z, &second.w);
+        if(TRACK_KIND_CUBIC == Kind)
+        {
+            LaneValue<glm::quat> previous, next;
+            DecodeSmallestThreeLanes(batch.previous, maxValue, &previous.x, &previous.y, &previous.z, &previous.w);
+            DecodeSmallestThreeLanes(batch.next, maxValue, &next.x, &next.y, &next.z, &next.w);
+            CubicBasis basis = GetCubicBasis(LaneLoad(batch.scaleFactor), LaneLoad(batch.firstWeight), LaneLoad(batch.secondWeight));
+            InterpolateCubicLanes(previous, first, second, next, basis, &result);
+        }
+        else
+        {
+            InterpolateLanes(first, second, LaneLoad(batch.scaleFactor), &result);
+        }
+        for(i32 lane = 0; lane < laneCount; ++lane)
+        {
+            localTransforms[batchTracks[lane]].rotation = GetLane(result, lane);
+        }
+    }
+}
+
+template<TrackKind Kind>
+internal void SampleQuantizedKind(const AnimationKeys &keys, const QuantizedKeys &quantized,
+                                  const TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    SampleQuantizedVec3Tracks<Kind>(keys, keys.positionBatches.tracks[Kind], keys.positionTracks, quantized.positions.data(),
+                                    quantized.positionRanges, cursors, localTransforms, &BoneTransform::translation);
+    SampleQuantizedRotationTracks<Kind>(keys, quantized, cursors, localTransforms);
+    SampleQuantizedVec3Tracks<Kind>(keys, keys.scaleBatches.tracks[Kind], keys.scaleTracks, quantized.scales.data(),
+                                    quantized.scaleRanges, cursors, localTransforms, &BoneTransform::scale);
+}
+
+// same as SamplePoseBatched, the keys of every lane are unpacked on the way in
+// and decoded and interpolated in lanes
+void SamplePoseQuantized(const AnimationKeys &keys, const QuantizedKeys &quantized, f32 animationTime,
+                         TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    SampleTimelines(keys, animationTime, cursors);
+    SampleQuantizedKind<TRACK_KIND_LINEAR_UNIFORM>(keys, quantized, cursors, localTransforms);
+    SampleQuantizedKind<TRACK_KIND_LINEAR_VARIABLE>(keys, quantized, cursors, localTransforms);
+    SampleQuantizedKind<TRACK_KIND_STEPPED>(keys, quantized, cursors, localTransforms);
+    SampleQuantizedKind<TRACK_KIND_CUBIC>(keys, quantized, cursors, localTransforms);
+}
+
+inline i32 GetLaneCount()
+{
+    return SAMPLER_LANES;
+}
+
+#undef SAMPLER_LANES
@@ -0,0 +1,193 @@
+#define COOKED_ANIM_MAGIC 0x4D494E41 // "ANIM"
+#define COOKED_ANIM_VERSION 6
+// no cooked clip is smaller than its track stats and the count before them,
+// a clip count past what the rest of the file can hold is a broken file
+#define COOKED_CLIP_MIN_BYTES (sizeof(u64) + sizeof(TrackStats))
+
+// false if the clip file does not exist. md5 meshes take their clips from
+// the md5anim next to them, it is a source even while it is missing
+internal b8 GetAnimationSources(const std::string &animationPath, std::vector<std::string> &sources)
+{
+    sources.assign(1, animationPath);
+    size_t extension = animationPath.find_last_of('.');
+    if(extension != std::string::npos && 0 == animationPath.compare(extension, std::string::npos, ".md5mesh"))
+    {
+        sources.push_back(animationPath.substr(0, extension) + ".md5anim");
+    }
+    return FileExists(animationPath.c_str());
+}
+
+// the clips also depend on the settings and on the bones the model already
+// knows, the import adds the missing ones after them
+internal u64 HashAnimationImport(const AnimationImportSettings &settings, Model &model)
+{
+    u64 hash = HASH_SEED;
+    hash = HashValue(settings.bakeRate, hash);
+    hash = HashValue(settings.compression, hash);
+    hash = HashValue(settings.positionTolerance, hash);
+    hash = HashValue(settings.rotationTolerance, hash);
+    hash = HashValue(settings.keepKeyTimes, hash);
+    hash = HashValue(settings.fitCurves, hash);
+    hash = HashValue(model.GetBoneCount(), hash);
+    auto &boneInfoMap = model.GetBoneInfoMap();
+    for(auto iter = boneInfoMap.begin(); iter != boneInfoMap.end(); ++iter)
+    {
+        hash = HashBytes(iter->first.data(), iter->first.size(), hash);
+        hash = HashValue(iter->second, hash);
+    }
+    return hash;
+}
+
+// every clip of a file from one import. The node hierarchy is read once and
+// all clips bind their tracks to it, so a node has the same index in the
+// pose of every clip of the library
+class AnimationLibrary
+{
+public:
+    // imports the file on its own unless a cache is passed that already
+    // holds it, the scene stays in the cache for the caller to release
+    AnimationLibrary(const std::string &animationPath, Model *model, const AnimationImportSettings &settings = {},
+                     SceneCache *scenes = nullptr)
+    {
+        // the cooked clips next to the file skip the import entirely
+        std::string cookedPath = animationPath + ".anim";
+        std::vector<std::string> sources;
+        b8 cookable = !settings.ignoreCooked && GetAnimationSources(animationPath, sources);
+        u64 importHash = HashAnimationImport(settings, *model);
+        if(cookable && LoadCooked(cookedPath, importHash, model))
+        {
+            return;
+        }
+
+        SceneCache ownScenes = {};
+        const aiScene *scene = ImportScene(scenes ? scenes : &ownScenes, animationPath, ANIMATION_IMPORT_FLAGS);
+        Assert(scene);
+
+        std::vector<std::string> nodeNames;
+        ReadSkeletonHierarchy(scene->mRootNode, &mSkeleton, nodeNames);
+
+        // reserved up front, animators keep pointers to the clips
+        i32 clipCount = (i32)scene->mNumAnimations;
+        mClips.reserve(clipCount);
+        for(i32 clipIndex = 0; clipIndex < clipCount; ++clipIndex)
+        {
+            const aiAnimation *animation = scene->mAnimations[clipIndex];
+            char clipPath[512];
+            snprintf(clipPath, sizeof(clipPath), "%s [%d %s]", animationPath.c_str(), clipIndex, animation->mName.data);
+            mClips.emplace_back(animation, mSkeleton, nodeNames, model, clipPath, settings);
+        }
+        BindSkeletonPalette(&mSkeleton, nodeNames, model->GetBoneInfoMap());
+        printf("Loaded %d clips from %s on %d nodes\n", clipCount, animationPath.c_str(), GetNodeCount(mSkeleton));
+        ReleaseScenes(&ownScenes);
+
+        if(cookable) Cook(cookedPath, sources, importHash);
+    }
+
+    // the clips point to the skeleton of the library
+    AnimationLibrary(const AnimationLibrary &) = delete;
+    AnimationLibrary &operator=(const AnimationLibrary &) = delete;
+
+    inline i32 GetClipCount() const
+    {
+        return (i32)mClips.size();
+    }
+
+    inline const Animation *GetClip(i32 index) const
+    {
+        Assert(index >= 0 && index < GetClipCount());
+        return &mClips[index];
+    }
+
+    // -1 if no clip of the file has that name
+    i32 FindClipIndex(const std::string &name) const
+    {
+        for(i32 clipIndex = 0; clipIndex < GetClipCount(); ++clipIndex)
+        {
+            if(mClips[clipIndex].GetName() == name) return clipIndex;
+        }
+        return -1;
+    }
+
+    const Animation *FindClip(const std::string &name) const
+    {
+        i32 clipIndex = FindClipIndex(name);
+        if(clipIndex < 0) return nullptr;
+        else return &mClips[clipIndex];
+    }
+
+    // hierarchy shared by the clips, without the tracks each clip binds
+    inline const Skeleton &GetSkeleton() const
+    {
+        return mSkeleton;
+    }
+
+private:
+
+    void Cook(const std::string &cookedPath, const std::vector<std::string> &sources, u64 importHash) const
+    {
+        CookedWriter writer;
+        BeginCookedFile(&writer, COOKED_ANIM_MAGIC, COOKED_ANIM_VERSION, sources, importHash);
+        WriteCookedSkeleton(&writer, mSkeleton);
+        WriteCookedValue(&writer, GetClipCount());
+        for(const Animation &clip : mClips) clip.Cook(&writer);
+        if(SaveCookedFile(&writer, cookedPath.c_str()))
+            printf("Cooked %d clips to %s: %.1f KB\n", GetClipCount(), cookedPath.c_str(), writer.bytes.size() / 1024.0);
+        else
+            printf("Cannot write %s\n", cookedPath.c_str());
+    }
+
+    // false if there is no cooked file or it is stale, nothing is changed then
+    b8 LoadCooked(const std::string &cookedPath, u64 importHash, Model *model)
+    {
+        MappedFile mapped;
+        if(!MapFile(cookedPath.c_str(), &mapped)) return false;
+
+        CookedReader reader;
+        b8 loaded = BeginCookedRead(&reader, mapped, COOKED_ANIM_MAGIC, COOKED_ANIM_VERSION, importHash);
+        if(loaded)
+        {
+            i32 clipCount = 0;
+            ReadCookedSkeleton(&reader, &mSkeleton);
+            ReadCookedValue(&reader, &clipCount);
+            if(clipCount < 0 || (u64)clipCount > (reader.size - reader.at) / COOKED_CLIP_MIN_BYTES)
+            {
+                reader.failed = true;
+            }
+            mClips.resize(reader.failed ? 0 : clipCount);
+            for(Animation &clip : mClips)
+            {
+                if(!clip.LoadCooked(&reader, &mSkeleton)) break;
+            }
+            loaded = !reader.failed;
+        }
+        UnmapFile(&mapped);
+
+        if(!loaded)
+        {
+            printf("Cooked clips %s are stale, importing\n", cookedPath.c_str());
+            mSkeleton = {};
+            mClips = std::vector<Animation>();
+            return false;
+        }
+        RestampCookedFile(reader, cookedPath.c_str());
+
+        // the bones the import would have added to the model
+        auto &boneInfoMap = model->GetBoneInfoMap();
+        i32 &boneCount = model->GetBoneCount();
+        for(const Animation &clip : mClips)
+        {
+            const std::map<std::string, BoneInfo> &clipInfoMap = clip.GetBoneIDMap();
+            for(auto iter = clipInfoMap.begin(); iter != clipInfoMap.end(); ++iter)
+            {
+                if(boneInfoMap.find(iter->first) != boneInfoMap.end()) continue;
+                boneInfoMap[iter->first] = iter->second;
+                boneCount = std::max(boneCount, iter->second.id + 1);
+            }
+        }
+        printf("Loaded %d cooked clips from %s\n", GetClipCount(), cookedPath.c_str());
+        return true;
+    }
+
+    Skeleton mSkeleton;
+    std::vector<Animation> mClips;
+};
@@ -1,4 +1,15 @@
 // Libraries...
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "../imgui/imgui.h"
 #include "../imgui/backends/imgui_impl_sdl.h"
 #include "../imgui/backends/imgui_impl_opengl3.h"
@@ -24,14 +35,27 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <new>
+#include <immintrin.h>
 // Headers
 #include "defines.h"
+#include "allocation.cpp"
 #include "shaders.cpp"
+#include "palette.cpp"
 
+#include "cooked.cpp"
+#include "optimize.cpp"
+#include "scene.cpp"
 #include "model.cpp"
 #include "bone.cpp"
+#include "quantize.cpp"
+#include "sampler.cpp"
+#include "skeleton.cpp"
 #include "animation.cpp"
+#include "library.cpp"
 #include "animator.cpp"
+#include "benchmark.cpp"
 
 struct Material
 {
@@ -91,19 +115,35 @@ int main(int argc, char *argv[])
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
     glEnable(GL_DEPTH_TEST); 
     stbi_set_flip_vertically_on_load(false);
+
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        RunAnimationBenchmarks("../assets/model/boblampclean.md5mesh");
+
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplSDL2_Shutdown();
+        ImGui::DestroyContext();
+        SDL_GL_DeleteContext(gl_context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 0;
+    }
     
     Model lightMesh("../assets/test.obj");
 
+    // the model and its clips are built from one import of the file
+    SceneCache scenes = {};
 #if 0
-    Model testModel("../assets/cowboy/model.dae");
-    Animation testAnimation("../assets/cowboy/model.dae", &testModel);
-    Animator animator(&testAnimation);
+    Model testModel("../assets/cowboy/model.dae", &scenes);
+    AnimationLibrary testAnimations("../assets/cowboy/model.dae", &testModel, {}, &scenes);
+    Animator animator(testAnimations.GetClip(0));
 #else
-    Model testModel("../assets/backpack/backpack.obj");
-    //Model testModel("../assets/model/boblampclean.md5mesh");
-    Animation testAnimation("../assets/model/boblampclean.md5mesh", &testModel);
-    Animator animator(&testAnimation);
+    Model testModel("../assets/backpack/backpack.obj", &scenes);
+    //Model testModel("../assets/model/boblampclean.md5mesh", &scenes);
+    AnimationLibrary testAnimations("../assets/model/boblampclean.md5mesh", &testModel, {}, &scenes);
+    Animator animator(testAnimations.GetClip(0));
 #endif
+    ReleaseScenes(&scenes);
 
     u32 vertexShader = CompileShaderFromFile("../src/shaders/vertex.glsl", GL_VERTEX_SHADER);
     u32 fragmentShader = CompileShaderFromFile("../src/shaders/fragment.glsl", GL_FRAGMENT_SHADER);
@@ -142,7 +182,6 @@ int main(int argc, char *argv[])
     i32 view = glGetUniformLocation(shaderProgram, "view");
     i32 world = glGetUniformLocation(shaderProgram, "world");
     i32 tex = glGetUniformLocation(shaderProgram, "texture0");
-    i32 gBones = glGetUniformLocation(shaderProgram, "gBones");
     i32 viewPos = glGetUniformLocation(shaderProgram, "viewPos");
 
     i32 ambientMat = glGetUniformLocation(shaderProgram, "material.ambient");
@@ -169,8 +208,14 @@ int main(int argc, char *argv[])
     glUniformMatrix4fv(projLigth, 1, false, &persProjMatrix[0][0]);
     glUniformMatrix4fv(viewLigth, 1, false, &viewMatrix[0][0]);
 
+    BonePaletteBuffer bonePalette = CreateBonePaletteBuffer(animator.GetFinalBoneCount());
+    const Animation *clip = testAnimations.GetClip(0);
+    const TrackStats &clipStats = clip->GetTrackStats();
+
     b8 running = true;
     u32 lastTime = 0;
+    u64 animationAllocatedBytes = 0;
+    u64 uploadedBytes = 0;
     while(running)
     {
         u32 currenTime = SDL_GetTicks();
@@ -227,6 +272,35 @@ int main(int argc, char *argv[])
         
         glUseProgram(ligthShaderProgram);
         glUniform3fv(ligthColor, 1, &specularLightColor[0]);
+
+        ImGui::Begin("Stats");
+        ImGui::Text("frame %.2f ms", dt * 1000.0f);
+        ImGui::Text("animation update allocated %llu bytes", (unsigned long long)animationAllocatedBytes);
+        ImGui::Text("uploaded %llu bytes", (unsigned long long)uploadedBytes);
+        ImGui::Text("clip %s: %d bones, %d static, %.1f KB of keys", clip->GetName().c_str(), clip->GetBoneCount(),
+                    clipStats.staticBones, clip->GetKeyBytes() / 1024.0);
+        ImGui::Text("folded constant (identity) positions %d (%d), rotations %d (%d), scales %d (%d)",
+                    clipStats.positions[TRACK_CONSTANT] + clipStats.positions[TRACK_IDENTITY],
+                    clipStats.positions[TRACK_IDENTITY],
+                    clipStats.rotations[TRACK_CONSTANT] + clipStats.rotations[TRACK_IDENTITY],
+                    clipStats.rotations[TRACK_IDENTITY],
+                    clipStats.scales[TRACK_CONSTANT] + clipStats.scales[TRACK_IDENTITY], clipStats.scales[TRACK_IDENTITY]);
+        ImGui::Text("tracks %d constant, %d uniform, %d variable, %d stepped, %d cubic",
+                    clipStats.kinds[TRACK_KIND_CONSTANT], clipStats.kinds[TRACK_KIND_LINEAR_UNIFORM],
+                    clipStats.kinds[TRACK_KIND_LINEAR_VARIABLE], clipStats.kinds[TRACK_KIND_STEPPED],
+                    clipStats.kinds[TRACK_KIND_CUBIC]);
+        ImGui::Text("%d timelines, %d searched per sample", clipStats.timelines, clipStats.searchedTimelines);
+        if(clipStats.sourceKeys > 0)
+        {
+            ImGui::Text("reduced keys %d -> %d, %.1f%% removed", clipStats.sourceKeys, clipStats.reducedKeys,
+                        100.0f * (clipStats.sourceKeys - clipStats.reducedKeys) / clipStats.sourceKeys);
+        }
+        if(clipStats.bakedSamples > 0)
+        {
+            ImGui::Text("baked to %d samples, max error position %f, rotation %f deg", clipStats.bakedSamples,
+                        clipStats.bakePositionError, glm::degrees(clipStats.bakeRotationError));
+        }
+        ImGui::End();
                 
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
@@ -244,12 +318,11 @@ int main(int argc, char *argv[])
         glUseProgram(shaderProgram);
         
         glUniform3fv(positionLight, 1, &lightPosV[0]);
+        u64 allocatedBytes = gAllocatedBytes;
         animator.UpdateAnimation(dt);
-        auto transforms = animator.GetFinalBoneMatrices();
-        for(i32 i = 0; i < transforms.size(); ++i)
-        {
-            glUniformMatrix4fv(gBones, (i32)transforms.size(), false, &transforms[0][0][0]);
-        }
+        animationAllocatedBytes = gAllocatedBytes - allocatedBytes;
+        UploadBonePalette(&bonePalette, animator.GetFinalBoneMatrices(), animator.GetFinalBoneCount());
+        BindBonePalette(&bonePalette);
 
         worldMatrix = glm::mat4(1.0f);
         worldMatrix = glm::translate(worldMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
@@ -265,6 +338,9 @@ int main(int argc, char *argv[])
 
         SDL_GL_SwapWindow(window);
 
+        uploadedBytes = gUploadedBytes;
+        gUploadedBytes = 0;
+
     }
 
     /* Shutdown all subsystems */
@@ -272,6 +348,7 @@ int main(int argc, char *argv[])
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
 
+    DestroyBonePaletteBuffer(&bonePalette);
     glDeleteProgram(shaderProgram);
 
     SDL_GL_DeleteContext(gl_context);
@@ -1,5 +1,12 @@
 #define MAX_BONE_INFLUENCE 4
 
+// imported meshes are uploaded as PackedVertex unless a bone index does not
+// fit in a byte, vertex.glsl decodes both layouts
+#define PACK_VERTICES 1
+
+#define COOKED_MESH_MAGIC 0x4853454D // "MESH"
+#define COOKED_MESH_VERSION 7
+
 struct Vertex
 {
     glm::vec3 position;
@@ -11,6 +18,154 @@ struct Vertex
     f32 weights[MAX_BONE_INFLUENCE];
 };
 
+// 32 bytes against the 88 of Vertex. The tangent frame is one quaternion
+// (QTangent) whose sign of w is the handedness of the bitangent, unused
+// influences have a weight of 0
+struct PackedVertex
+{
+    glm::vec3 position;
+    i16 qtangent[4];                // snorm16 x y z w
+    u16 texCoords[2];               // half floats
+    u8 boneIDs[MAX_BONE_INFLUENCE];
+    u8 weights[MAX_BONE_INFLUENCE]; // unorm8, they sum to 255
+};
+
+enum VertexFormat
+{
+    VERTEX_FORMAT_FULL,   // Vertex
+    VERTEX_FORMAT_PACKED, // PackedVertex
+};
+
+// meshes with at most this many vertices draw with 16 bit indices
+#define MAX_SHORT_INDEX_VERTICES 65536
+
+inline u32 GetIndexType(i32 indexSize)
+{
+    return 2 == indexSize ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline i32 GetVertexStride(VertexFormat format)
+{
+    return VERTEX_FORMAT_PACKED == format ? (i32)sizeof(PackedVertex) : (i32)sizeof(Vertex);
+}
+
+// round to nearest even, out of range values become infinity
+inline u16 FloatToHalf(f32 value)
+{
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u32 sign = (bits >> 16) & 0x8000;
+    i32 exponent = (i32)((bits >> 23) & 0xff) - 127 + 15;
+    u32 mantissa = bits & 0x7fffff;
+    if(exponent >= 31)
+    {
+        b8 isNan = (bits & 0x7fffffff) > 0x7f800000;
+        return (u16)(sign | 0x7c00 | (isNan ? 0x200 : 0));
+    }
+    if(exponent <= 0)
+    {
+        // subnormal half, the implicit one becomes part of the mantissa
+        if(exponent < -10) return (u16)sign;
+        mantissa |= 0x800000;
+        u32 shift = (u32)(14 - exponent);
+        u32 half = mantissa >> shift;
+        u32 rest = mantissa & ((1u << shift) - 1);
+        u32 halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return (u16)(sign | half);
+    }
+    u32 half = ((u32)exponent << 10) | (mantissa >> 13);
+    u32 rest = mantissa & 0x1fff;
+    // a carry out of the mantissa correctly bumps the exponent
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;
+    return (u16)(sign | half);
+}
+
+inline i16 PackSnorm16(f32 value)
+{
+    return (i16)roundf(fminf(fmaxf(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+// rotation that takes x, y and z to the tangent, bitangent and normal.
+// The frame is made orthonormal first, w is kept away from zero so its sign
+// survives snorm16 and then carries the handedness
+inline void PackQTangent(glm::vec3 normal, glm::vec3 tangent, glm::vec3 bitangent, i16 *qtangent)
+{
+    glm::vec3 n = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 t = tangent - n * glm::dot(n, tangent);
+    if(!(glm::length(t) >= 1e-6f))
+    {
+        // no usable tangent, any direction orthogonal to the normal will do
+        glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        t = axis - n * glm::dot(n, axis);
+    }
+    t = glm::normalize(t);
+    glm::vec3 b = glm::cross(n, t);
+    f32 handedness = glm::dot(b, bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+    if(q.w < 0.0f) q = -q;
+    const f32 bias = 1.0f / 32767.0f;
+    if(q.w < bias)
+    {
+        f32 scale = sqrtf(1.0f - bias * bias);
+        q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+    }
+    if(handedness < 0.0f) q = -q;
+
+    qtangent[0] = PackSnorm16(q.x);
+    qtangent[1] = PackSnorm16(q.y);
+    qtangent[2] = PackSnorm16(q.z);
+    qtangent[3] = PackSnorm16(q.w);
+}
+
+// the rounding error goes to the largest weight so the sum stays exact
+inline void PackWeights(const f32 *weights, u8 *packed)
+{
+    f32 sum = 0.0f;
+    for(i32 i = 0; i < MAX_BONE_INFLUENCE; ++i) sum += fmaxf(weights[i], 0.0f);
+    if(sum <= 0.0f)
+    {
+        for(i32 i = 0; i < MAX_BONE_INFLUENCE; ++i) packed[i] = 0;
+        return;
+    }
+    i32 total = 0;
+    i32 largest = 0;
+    for(i32 i = 0; i < MAX_BONE_INFLUENCE; ++i)
+    {
+        packed[i] = (u8)roundf(fmaxf(weights[i], 0.0f) / sum * 255.0f);
+        total += packed[i];
+        if(weights[i] > weights[largest]) largest = i;
+    }
+    packed[largest] = (u8)(packed[largest] + 255 - total);
+}
+
+// false if a bone index does not fit in a byte, the mesh keeps Vertex then
+b8 PackVertices(const std::vector<Vertex> &vertices, std::vector<PackedVertex> &packed)
+{
+    packed.resize(vertices.size());
+    for(u32 vertexIndex = 0; vertexIndex < vertices.size(); ++vertexIndex)
+    {
+        const Vertex &src = vertices[vertexIndex];
+        PackedVertex &dst = packed[vertexIndex];
+        dst.position = src.position;
+        PackQTangent(src.normal, src.tangent, src.bitangent, dst.qtangent);
+        dst.texCoords[0] = FloatToHalf(src.texCoords.x);
+        dst.texCoords[1] = FloatToHalf(src.texCoords.y);
+
+        f32 weights[MAX_BONE_INFLUENCE];
+        for(i32 i = 0; i < MAX_BONE_INFLUENCE; ++i)
+        {
+            if(src.boneIDs[i] > 255) return false;
+            b8 used = src.boneIDs[i] >= 0;
+            dst.boneIDs[i] = used ? (u8)src.boneIDs[i] : 0;
+            weights[i] = used ? src.weights[i] : 0.0f;
+        }
+        PackWeights(weights, dst.weights);
+    }
+    return true;
+}
+
 struct Texture
 {
     u32 id;
@@ -50,19 +205,23 @@ inline glm::quat GetGLMQuat(const aiQuaternion& pOrientation)
 class Mesh
 {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<u32> indices;
     std::vector<Texture> textures;
     u32 VAO;
-
-    // constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<u32> indices, std::vector<Texture> textures)
+    i32 indexCount;
+    i32 indexSize; // 2 or 4 bytes
+    VertexFormat vertexFormat;
+
+    // uploads the vertex and index blobs as they are, so they can point
+    // straight into a mapped cooked mesh
+    Mesh(const void *vertices, i32 vertexCount, VertexFormat vertexFormat, const void *indices, i32 indexCount,
+         i32 indexSize, std::vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
+        this->indexCount = indexCount;
+        this->indexSize = indexSize;
+        this->vertexFormat = vertexFormat;
         this->textures = textures;
 
-        setupMesh();
+        setupMesh(vertices, vertexCount, indices);
     }
 
     void Draw(u32 shaderProgram)
@@ -96,8 +255,14 @@ public:
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
+        if(shaderProgram != uniformProgram)
+        {
+            uniformProgram = shaderProgram;
+            packedVerticesLocation = glGetUniformLocation(shaderProgram, "packedVertices");
+        }
+        glUniform1i(packedVerticesLocation, VERTEX_FORMAT_PACKED == vertexFormat);
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<u32>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, GetIndexType(indexSize), 0);
         glBindVertexArray(0);
 
         glActiveTexture(GL_TEXTURE0);
@@ -105,8 +270,11 @@ public:
 
 private:
     u32 VBO, EBO;
+    // looked up on the first draw with a program, not on every draw
+    u32 uniformProgram = 0;
+    i32 packedVerticesLocation = -1;
 
-    void setupMesh()
+    void setupMesh(const void *vertices, i32 vertexCount, const void *indices)
     {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -114,31 +282,81 @@ private:
 
         glBindVertexArray(VAO);
         
+        i32 stride = GetVertexStride(vertexFormat);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, vertices, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), &indices[0], GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, texCoords));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, tangent));
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, bitangent));
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *)offsetof(Vertex, boneIDs));
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, weights));
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+
+        if(VERTEX_FORMAT_PACKED == vertexFormat)
+        {
+            // the normal, tangent and bitangent slots stay disabled, the
+            // shader rebuilds them from the qtangent in slot 7
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(PackedVertex, position));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offsetof(PackedVertex, texCoords));
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, stride, (void *)offsetof(PackedVertex, boneIDs));
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(PackedVertex, weights));
+            glEnableVertexAttribArray(7);
+            glVertexAttribPointer(7, 4, GL_SHORT, GL_TRUE, stride, (void *)offsetof(PackedVertex, qtangent));
+        }
+        else
+        {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, texCoords));
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, tangent));
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, bitangent));
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_INT, stride, (void *)offsetof(Vertex, boneIDs));
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, weights));
+        }
 
         glBindVertexArray(0);
     }
 };
 
+// the material libraries an obj file names. The materials of its meshes,
+// and with them the texture paths they are cooked with, come from those
+// files, so they are sources of the cooked mesh like the obj itself
+void AddMaterialLibraries(const std::string &path, std::vector<std::string> &sources)
+{
+    size_t extension = path.find_last_of('.');
+    if(extension == std::string::npos || 0 != path.compare(extension, std::string::npos, ".obj")) return;
+    MappedFile mapped;
+    if(!MapFile(path.c_str(), &mapped)) return;
+
+    size_t slash = path.find_last_of("/\\");
+    std::string folder = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    const char *end = (const char *)mapped.data + mapped.size;
+    for(const char *line = (const char *)mapped.data; line < end;)
+    {
+        const char *lineEnd = (const char *)memchr(line, '\n', end - line);
+        if(!lineEnd) lineEnd = end;
+        while(line < lineEnd && (*line == ' ' || *line == '\t')) ++line;
+        if(lineEnd - line > 7 && 0 == strncmp(line, "mtllib", 6) && (line[6] == ' ' || line[6] == '\t'))
+        {
+            const char *name = line + 7;
+            const char *nameEnd = lineEnd;
+            while(name < nameEnd && (*name == ' ' || *name == '\t')) ++name;
+            while(nameEnd > name && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t' || nameEnd[-1] == '\r')) --nameEnd;
+            if(nameEnd > name) sources.push_back(folder + std::string(name, nameEnd));
+        }
+        line = lineEnd + 1;
+    }
+    UnmapFile(&mapped);
+}
+
 class Model
 {
 public:
@@ -150,7 +368,17 @@ public:
     Model(std::string const &path, bool gamma = false)
         : gammaCorrection(gamma)
     {
-        loadModel(path);
+        SceneCache scenes = {};
+        loadModel(path, &scenes, false);
+        ReleaseScenes(&scenes);
+    }
+
+    // takes the scene from the cache, so the clips of the same file can be
+    // built from it without a second import
+    Model(std::string const &path, SceneCache *scenes, bool gamma = false, bool ignoreCooked = false)
+        : gammaCorrection(gamma)
+    {
+        loadModel(path, scenes, ignoreCooked);
     }
 
     void Draw(u32 shaderProgram)
@@ -175,34 +403,152 @@ private:
     std::map<std::string, BoneInfo> boneInfoMap;
     i32 boneCounter = 0;
 
-    void loadModel(std::string const &path)
+    void loadModel(std::string const &path, SceneCache *scenes, bool ignoreCooked)
     {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // the cooked mesh next to the file skips the import entirely
+        std::string cookedPath = path + ".amesh";
+        b8 cookable = !ignoreCooked && FileExists(path.c_str());
+        u64 importHash = HashValue((u32)MODEL_IMPORT_FLAGS, HASH_SEED);
+        importHash = HashValue((u32)PACK_VERTICES, importHash);
+        if(cookable && loadCooked(cookedPath, importHash))
+        {
+            return;
+        }
+
+        const aiScene *scene = ImportScene(scenes, path, MODEL_IMPORT_FLAGS);
+        if(!scene)
         {
             printf("Error Loading Model\n");
-            printf(importer.GetErrorString());
-            printf("\n");
             return; 
         }
 
-        directory = path.substr(0, path.find_last_of('/'));
+        CookedWriter writer;
+        std::vector<std::string> sources(1, path);
+        AddMaterialLibraries(path, sources);
+        BeginCookedFile(&writer, COOKED_MESH_MAGIC, COOKED_MESH_VERSION, sources, importHash);
+        WriteCookedValue(&writer, countNodeMeshes(scene->mRootNode));
+        MeshOptimizeStats stats = {};
+        processNode(scene->mRootNode, scene, &writer, &stats);
+        printf("Optimized %s: vertices %d -> %d, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %d overdraw clusters\n",
+               path.c_str(), stats.sourceVertices, stats.vertices,
+               GetACMR(stats.sourceMisses, stats.triangles), GetACMR(stats.misses, stats.triangles),
+               GetATVR(stats.sourceMisses, stats.sourceVertices), GetATVR(stats.misses, stats.vertices), stats.clusters);
+        WriteCookedValue(&writer, boneCounter);
+        WriteCookedValue(&writer, (i32)boneInfoMap.size());
+        for(auto iter = boneInfoMap.begin(); iter != boneInfoMap.end(); ++iter)
+        {
+            WriteCookedString(&writer, iter->first);
+            WriteCookedValue(&writer, iter->second);
+        }
+        if(cookable && !SaveCookedFile(&writer, cookedPath.c_str()))
+        {
+            printf("Cannot write %s\n", cookedPath.c_str());
+        }
+    }
+
+    // false if there is no cooked mesh or it is stale, nothing is changed then
+    bool loadCooked(const std::string &cookedPath, u64 importHash)
+    {
+        MappedFile mapped;
+        if(!MapFile(cookedPath.c_str(), &mapped)) return false;
+
+        CookedReader reader;
+        if(!BeginCookedRead(&reader, mapped, COOKED_MESH_MAGIC, COOKED_MESH_VERSION, importHash))
+        {
+            printf("Cooked mesh %s is stale, importing\n", cookedPath.c_str());
+            UnmapFile(&mapped);
+            return false;
+        }
+
+        // the blobs are checked before anything is uploaded, the meshes then
+        // go to the gpu straight from the mapping
+        i32 meshCount = 0;
+        ReadCookedValue(&reader, &meshCount);
+        CookedReader meshReader = reader;
+        for(i32 meshIndex = 0; meshIndex < meshCount && !reader.failed; ++meshIndex)
+        {
+            readCookedMesh(&reader, 0);
+        }
+        std::map<std::string, BoneInfo> cookedInfoMap;
+        i32 cookedBoneCount = 0;
+        ReadCookedValue(&reader, &cookedBoneCount);
+        i32 boneInfoCount = 0;
+        ReadCookedValue(&reader, &boneInfoCount);
+        for(i32 infoIndex = 0; infoIndex < boneInfoCount && !reader.failed; ++infoIndex)
+        {
+            std::string name;
+            ReadCookedString(&reader, name);
+            ReadCookedValue(&reader, &cookedInfoMap[name]);
+        }
+        if(reader.failed || meshCount < 0)
+        {
+            printf("Cooked mesh %s is stale, importing\n", cookedPath.c_str());
+            UnmapFile(&mapped);
+            return false;
+        }
 
-        processNode(scene->mRootNode, scene);
+        meshes.reserve(meshCount);
+        for(i32 meshIndex = 0; meshIndex < meshCount; ++meshIndex)
+        {
+            readCookedMesh(&meshReader, &meshes);
+        }
+        boneInfoMap = cookedInfoMap;
+        boneCounter = cookedBoneCount;
+        UnmapFile(&mapped);
+        RestampCookedFile(reader, cookedPath.c_str());
+        return true;
     }
 
-    void processNode(aiNode *node, const aiScene *scene)
+    // one cooked mesh, only checked when meshes is null
+    void readCookedMesh(CookedReader *reader, std::vector<Mesh> *meshes)
+    {
+        VertexFormat vertexFormat = VERTEX_FORMAT_FULL;
+        ReadCookedValue(reader, &vertexFormat);
+        i32 indexSize = 4;
+        ReadCookedValue(reader, &indexSize);
+        u64 vertexBytes, indexBytes;
+        const u8 *vertices = ReadCookedArray<u8>(reader, &vertexBytes);
+        const u8 *indices = ReadCookedArray<u8>(reader, &indexBytes);
+        if(vertexFormat != VERTEX_FORMAT_FULL && vertexFormat != VERTEX_FORMAT_PACKED) reader->failed = true;
+        if(indexSize != 2 && indexSize != 4) reader->failed = true;
+        i32 vertexCount = (i32)(vertexBytes / GetVertexStride(vertexFormat));
+        i32 indexCount = reader->failed ? 0 : (i32)(indexBytes / indexSize);
+        i32 textureCount = 0;
+        ReadCookedValue(reader, &textureCount);
+        std::vector<Texture> textures;
+        for(i32 textureIndex = 0; textureIndex < textureCount && !reader->failed; ++textureIndex)
+        {
+            std::string typeName, texturePath;
+            ReadCookedString(reader, typeName);
+            ReadCookedString(reader, texturePath);
+            if(meshes) textures.push_back(loadTexture(texturePath.c_str(), typeName));
+        }
+        if(meshes) meshes->push_back(Mesh(vertices, vertexCount, vertexFormat, indices, indexCount, indexSize, textures));
+    }
+
+    i32 countNodeMeshes(const aiNode *node)
+    {
+        i32 count = node->mNumMeshes;
+        for(u32 i = 0; i < node->mNumChildren; ++i)
+        {
+            count += countNodeMeshes(node->mChildren[i]);
+        }
+        return count;
+    }
+
+    void processNode(aiNode *node, const aiScene *scene, CookedWriter *writer, MeshOptimizeStats *stats)
     {
         for(u32 i = 0; i < node->mNumMeshes; ++i)
         {
             aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(processMesh(mesh, scene, writer, stats));
         }
 
         for(u32 i = 0; i < node->mNumChildren; ++i)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, writer, stats);
         }
     }
 
@@ -215,7 +561,7 @@ private:
         } 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    Mesh processMesh(aiMesh *mesh, const aiScene *scene, CookedWriter *writer, MeshOptimizeStats *stats)
     {
         std::vector<Vertex> vertices;
         std::vector<u32> indices;
@@ -243,7 +589,10 @@ private:
 
         for(u32 i = 0; i < mesh->mNumFaces; ++i)
         {
+            // the meshes draw triangles only, the points and lines the
+            // triangulation leaves are dropped
             aiFace face = mesh->mFaces[i];
+            if(face.mNumIndices != 3) continue;
             for(u32 j = 0; j < face.mNumIndices; ++j)
             {
                 indices.push_back(face.mIndices[j]);
@@ -261,8 +610,43 @@ private:
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         ExtractBoneWeightForVertices(vertices, mesh, scene);
+        AddMeshOptimizeStats(stats, OptimizeMesh(vertices, indices));
+
+        std::vector<PackedVertex> packedVertices;
+        VertexFormat vertexFormat = VERTEX_FORMAT_FULL;
+        const void *vertexData = vertices.data();
+        if(PACK_VERTICES && PackVertices(vertices, packedVertices))
+        {
+            vertexFormat = VERTEX_FORMAT_PACKED;
+            vertexData = packedVertices.data();
+        }
+        i32 vertexCount = (i32)vertices.size();
+
+        // half the index bytes whenever every index fits in 16 bits
+        std::vector<u16> shortIndices;
+        i32 indexSize = 4;
+        const void *indexData = indices.data();
+        i32 indexCount = (i32)indices.size();
+        if(vertexCount <= MAX_SHORT_INDEX_VERTICES)
+        {
+            shortIndices.resize(indexCount);
+            for(i32 i = 0; i < indexCount; ++i) shortIndices[i] = (u16)indices[i];
+            indexSize = 2;
+            indexData = shortIndices.data();
+        }
 
-        return Mesh(vertices, indices, textures);
+        WriteCookedValue(writer, vertexFormat);
+        WriteCookedValue(writer, indexSize);
+        WriteCookedArray(writer, (const u8 *)vertexData, (u64)vertexCount * GetVertexStride(vertexFormat));
+        WriteCookedArray(writer, (const u8 *)indexData, (u64)indexCount * indexSize);
+        WriteCookedValue(writer, (i32)textures.size());
+        for(const Texture &texture : textures)
+        {
+            WriteCookedString(writer, texture.type);
+            WriteCookedString(writer, texture.path);
+        }
+
+        return Mesh(vertexData, vertexCount, vertexFormat, indexData, indexCount, indexSize, textures);
     }
 
     void SetVertexBoneData(Vertex &vertex, i32 boneID, f32 weight)
@@ -353,6 +737,24 @@ private:
         return textureID;
     }
 
+    // textures are loaded once per path and shared between the meshes
+    Texture loadTexture(const char *path, const std::string &typeName)
+    {
+        for(u32 j = 0; j < texturesLoaded.size(); j++)
+        {
+            if(std::strcmp(texturesLoaded[j].path.data(), path) == 0)
+            {
+                return texturesLoaded[j];
+            }
+        }
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        texturesLoaded.push_back(texture); 
+        return texture;
+    }
+
     std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
     {
         std::vector<Texture> textures;
@@ -360,26 +762,7 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-
-            bool skip = false;
-            for(u32 j = 0; j < texturesLoaded.size(); j++)
-            {
-                if(std::strcmp(texturesLoaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(texturesLoaded[j]);
-                    skip = true;
-                    break;
-                }
-            }
-            if(!skip)
-            {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                texturesLoaded.push_back(texture); 
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
@@ -0,0 +1,344 @@
+// import time optimization of the index and vertex buffers of a mesh. None
+// of it touches the gpu, the stats compare the buffers before and after
+#define VERTEX_CACHE_SIZE 16
+// a cluster sorted for overdraw may miss the cache this many times as often
+// as the fan order it was cut from, smaller clusters sort better
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+struct MeshOptimizeStats
+{
+    i32 sourceVertices;
+    i32 vertices;
+    i32 triangles;
+    i32 sourceMisses; // of a FIFO cache of VERTEX_CACHE_SIZE entries
+    i32 misses;
+    i32 clusters;     // sorted for overdraw
+};
+
+inline void AddMeshOptimizeStats(MeshOptimizeStats *total, const MeshOptimizeStats &stats)
+{
+    total->sourceVertices += stats.sourceVertices;
+    total->vertices += stats.vertices;
+    total->triangles += stats.triangles;
+    total->sourceMisses += stats.sourceMisses;
+    total->misses += stats.misses;
+    total->clusters += stats.clusters;
+}
+
+// average cache miss ratio, transformed vertices per triangle
+inline f32 GetACMR(i32 misses, i32 triangles)
+{
+    return triangles > 0 ? (f32)misses / triangles : 0.0f;
+}
+
+// average transform to vertex ratio, 1 is every vertex transformed once
+inline f32 GetATVR(i32 misses, i32 vertices)
+{
+    return vertices > 0 ? (f32)misses / vertices : 0.0f;
+}
+
+// vertices the post transform cache misses drawing the indices in order
+i32 CountCacheMisses(const u32 *indices, i32 indexCount, i32 vertexCount)
+{
+    std::vector<i32> insertedAt(vertexCount, -VERTEX_CACHE_SIZE - 1);
+    i32 misses = 0;
+    for(i32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        if(misses - insertedAt[vertex] > VERTEX_CACHE_SIZE)
+        {
+            insertedAt[vertex] = misses;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+// misses of the triangles [first, end) on the same cache, carried over from
+// the previous call. Moving time on by more than VERTEX_CACHE_SIZE empties it
+internal i32 SimulateCache(const u32 *indices, i32 first, i32 end, std::vector<i32> &insertedAt, i32 *time)
+{
+    i32 start = *time;
+    for(i32 i = first * 3; i < end * 3; ++i)
+    {
+        u32 vertex = indices[i];
+        if(*time - insertedAt[vertex] > VERTEX_CACHE_SIZE)
+        {
+            insertedAt[vertex] = (*time)++;
+        }
+    }
+    return *time - start;
+}
+
+// merges vertices that are equal byte for byte and remaps the indices
+template<typename VertexType>
+void WeldVertices(std::vector<VertexType> &vertices, std::vector<u32> &indices)
+{
+    i32 vertexCount = (i32)vertices.size();
+    i32 tableSize = 1;
+    while(tableSize < vertexCount * 2) tableSize *= 2;
+    std::vector<i32> table(tableSize, -1);
+    std::vector<u32> remap(vertexCount);
+
+    i32 weldedCount = 0;
+    for(i32 vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex)
+    {
+        const VertexType &vertex = vertices[vertexIndex];
+        u32 slot = (u32)HashBytes(&vertex, sizeof(VertexType)) & (tableSize - 1);
+        while(table[slot] >= 0 && memcmp(&vertices[table[slot]], &vertex, sizeof(VertexType)) != 0)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if(table[slot] < 0)
+        {
+            // welded vertices move to the front, never past their own index
+            vertices[weldedCount] = vertex;
+            table[slot] = weldedCount++;
+        }
+        remap[vertexIndex] = (u32)table[slot];
+    }
+
+    vertices.resize(weldedCount);
+    for(u32 &index : indices) index = remap[index];
+}
+
+// next vertex to fan around, the most recently used one still in the cache
+// that has triangles left, else one off the dead end stack or the next one
+// in order with triangles left, which sets jumped. -1 once every triangle
+// is out
+internal i32 GetNextFanVertex(const std::vector<i32> &candidates, const std::vector<i32> &liveTriangles,
+                              const std::vector<i32> &cacheTimes, i32 time, std::vector<i32> &deadEnds,
+                              i32 *nextInOrder, b8 *jumped)
+{
+    *jumped = false;
+    i32 best = -1;
+    i32 bestPriority = -1;
+    for(i32 vertex : candidates)
+    {
+        if(liveTriangles[vertex] <= 0) continue;
+        // a fan of the vertex must not push it out of the cache on its own
+        i32 priority = 0;
+        if(time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= VERTEX_CACHE_SIZE)
+        {
+            priority = time - cacheTimes[vertex];
+        }
+        if(priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = vertex;
+        }
+    }
+    if(best >= 0) return best;
+
+    *jumped = true;
+    while(!deadEnds.empty())
+    {
+        i32 vertex = deadEnds.back();
+        deadEnds.pop_back();
+        if(liveTriangles[vertex] > 0) return vertex;
+    }
+    i32 vertexCount = (i32)liveTriangles.size();
+    while(*nextInOrder < vertexCount)
+    {
+        i32 vertex = (*nextInOrder)++;
+        if(liveTriangles[vertex] > 0) return vertex;
+    }
+    return -1;
+}
+
+// Tipsify (Sander, Nehab and Barczak 2007): emits the triangles as fans
+// around vertices picked to stay in a cache of VERTEX_CACHE_SIZE entries,
+// linear in the number of triangles. Clusters gets the first triangle of
+// every run of fans, a new one starts wherever the order jumps to a vertex
+// that is not in the cache
+void ReorderTrianglesForCache(std::vector<u32> &indices, i32 vertexCount, std::vector<i32> &clusters)
+{
+    clusters.clear();
+    i32 triangleCount = (i32)indices.size() / 3;
+    if(triangleCount == 0) return;
+
+    // triangles of every vertex
+    std::vector<i32> liveTriangles(vertexCount, 0);
+    for(u32 index : indices) ++liveTriangles[index];
+    std::vector<i32> offsets(vertexCount + 1, 0);
+    for(i32 vertex = 0; vertex < vertexCount; ++vertex) offsets[vertex + 1] = offsets[vertex] + liveTriangles[vertex];
+    std::vector<i32> vertexTriangles(offsets[vertexCount]);
+    std::vector<i32> filled(offsets.begin(), offsets.end() - 1);
+    for(i32 i = 0; i < triangleCount * 3; ++i) vertexTriangles[filled[indices[i]]++] = i / 3;
+
+    std::vector<i32> cacheTimes(vertexCount, 0);
+    std::vector<b8> emitted(triangleCount, false);
+    std::vector<i32> deadEnds;
+    std::vector<i32> candidates;
+    std::vector<u32> output;
+    output.reserve(triangleCount * 3);
+
+    i32 time = VERTEX_CACHE_SIZE + 1;
+    i32 nextInOrder = 1;
+    i32 fan = 0;
+    b8 jumped = true;
+    while(fan >= 0)
+    {
+        if(jumped) clusters.push_back((i32)output.size() / 3);
+        candidates.clear();
+        for(i32 i = offsets[fan]; i < offsets[fan + 1]; ++i)
+        {
+            i32 triangle = vertexTriangles[i];
+            if(emitted[triangle]) continue;
+            emitted[triangle] = true;
+            for(i32 corner = 0; corner < 3; ++corner)
+            {
+                u32 vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if(time - cacheTimes[vertex] > VERTEX_CACHE_SIZE)
+                {
+                    cacheTimes[vertex] = time++;
+                }
+            }
+        }
+        fan = GetNextFanVertex(candidates, liveTriangles, cacheTimes, time, deadEnds, &nextInOrder, &jumped);
+    }
+
+    Assert((i32)output.size() == triangleCount * 3);
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+// Tipsify's soft boundaries, a cluster is cut again wherever the triangles
+// since the last cut miss the cache at most OVERDRAW_ACMR_THRESHOLD times
+// as often as the whole cluster drawn on its own
+void SplitClusters(const std::vector<u32> &indices, i32 vertexCount, std::vector<i32> &clusters)
+{
+    i32 triangleCount = (i32)indices.size() / 3;
+    std::vector<i32> insertedAt(vertexCount, -VERTEX_CACHE_SIZE - 1);
+    i32 time = 0;
+    std::vector<i32> split;
+    for(i32 clusterIndex = 0; clusterIndex < (i32)clusters.size(); ++clusterIndex)
+    {
+        i32 first = clusters[clusterIndex];
+        i32 end = clusterIndex + 1 < (i32)clusters.size() ? clusters[clusterIndex + 1] : triangleCount;
+        time += VERTEX_CACHE_SIZE + 1;
+        i32 clusterMisses = SimulateCache(indices.data(), first, end, insertedAt, &time);
+        f32 threshold = OVERDRAW_ACMR_THRESHOLD * GetACMR(clusterMisses, end - first);
+
+        split.push_back(first);
+        time += VERTEX_CACHE_SIZE + 1;
+        i32 misses = 0;
+        i32 triangles = 0;
+        for(i32 triangle = first; triangle < end - 1; ++triangle)
+        {
+            misses += SimulateCache(indices.data(), triangle, triangle + 1, insertedAt, &time);
+            ++triangles;
+            if(GetACMR(misses, triangles) <= threshold)
+            {
+                split.push_back(triangle + 1);
+                time += VERTEX_CACHE_SIZE + 1;
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+    clusters.swap(split);
+}
+
+// Tipsify's view independent overdraw order: the clusters that face away
+// from the center of the mesh are the likeliest to occlude the others, so
+// they are drawn first, sorted by the dot product of their normal and their
+// offset from the center
+template<typename VertexType>
+void SortClustersForOverdraw(const std::vector<VertexType> &vertices, std::vector<u32> &indices,
+                             const std::vector<i32> &clusters)
+{
+    i32 triangleCount = (i32)indices.size() / 3;
+    i32 clusterCount = (i32)clusters.size();
+    if(clusterCount < 2) return;
+
+    glm::vec3 meshCenter = glm::vec3(0.0f);
+    for(u32 index : indices) meshCenter += vertices[index].position;
+    meshCenter /= (f32)indices.size();
+
+    // area weighted, a cluster without area sorts as if it faced nowhere
+    std::vector<f32> facing(clusterCount);
+    for(i32 clusterIndex = 0; clusterIndex < clusterCount; ++clusterIndex)
+    {
+        i32 end = clusterIndex + 1 < clusterCount ? clusters[clusterIndex + 1] : triangleCount;
+        glm::vec3 center = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        f32 area = 0.0f;
+        for(i32 triangle = clusters[clusterIndex]; triangle < end; ++triangle)
+        {
+            glm::vec3 p0 = vertices[indices[triangle * 3 + 0]].position;
+            glm::vec3 p1 = vertices[indices[triangle * 3 + 1]].position;
+            glm::vec3 p2 = vertices[indices[triangle * 3 + 2]].position;
+            glm::vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);
+            f32 triangleArea = glm::length(triangleNormal);
+            center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += triangleNormal;
+            area += triangleArea;
+        }
+        f32 normalLength = glm::length(normal);
+        if(area > 0.0f) center /= area;
+        if(normalLength > 0.0f) normal /= normalLength;
+        facing[clusterIndex] = glm::dot(center - meshCenter, normal);
+    }
+
+    std::vector<i32> order(clusterCount);
+    for(i32 clusterIndex = 0; clusterIndex < clusterCount; ++clusterIndex) order[clusterIndex] = clusterIndex;
+    std::stable_sort(order.begin(), order.end(), [&](i32 a, i32 b) { return facing[a] > facing[b]; });
+
+    std::vector<u32> sorted;
+    sorted.reserve(indices.size());
+    for(i32 clusterIndex : order)
+    {
+        i32 end = clusterIndex + 1 < clusterCount ? clusters[clusterIndex + 1] : triangleCount;
+        sorted.insert(sorted.end(), indices.begin() + clusters[clusterIndex] * 3, indices.begin() + end * 3);
+    }
+    indices.swap(sorted);
+}
+
+// vertices in the order the indices first use them, so the vertex fetch
+// walks the buffer forward. Vertices no index uses are dropped
+template<typename VertexType>
+void ReorderVerticesForFetch(std::vector<VertexType> &vertices, std::vector<u32> &indices)
+{
+    std::vector<i32> remap(vertices.size(), -1);
+    std::vector<VertexType> ordered;
+    ordered.reserve(vertices.size());
+    for(u32 &index : indices)
+    {
+        if(remap[index] < 0)
+        {
+            remap[index] = (i32)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = (u32)remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+// welds, reorders the triangles for the post transform cache, sorts runs of
+// them for overdraw and reorders the vertices for the fetch. The indices
+// must be a triangle list
+template<typename VertexType>
+MeshOptimizeStats OptimizeMesh(std::vector<VertexType> &vertices, std::vector<u32> &indices)
+{
+    Assert(indices.size() % 3 == 0);
+    MeshOptimizeStats stats = {};
+    stats.sourceVertices = (i32)vertices.size();
+    stats.triangles = (i32)indices.size() / 3;
+    stats.sourceMisses = CountCacheMisses(indices.data(), (i32)indices.size(), (i32)vertices.size());
+
+    WeldVertices(vertices, indices);
+    std::vector<i32> clusters;
+    ReorderTrianglesForCache(indices, (i32)vertices.size(), clusters);
+    SplitClusters(indices, (i32)vertices.size(), clusters);
+    SortClustersForOverdraw(vertices, indices, clusters);
+    ReorderVerticesForFetch(vertices, indices);
+
+    stats.vertices = (i32)vertices.size();
+    stats.clusters = (i32)clusters.size();
+    stats.misses = CountCacheMisses(indices.data(), (i32)indices.size(), (i32)vertices.size());
+    return stats;
+}
@@ -0,0 +1,53 @@
+// shader storage buffer with the final bone matrices of one character,
+// the vertex shader reads it from BONE_PALETTE_BINDING
+#define BONE_PALETTE_BINDING 0
+
+// bytes sent to the gpu through palette uploads, the frame stats reset it
+global_variable u64 gUploadedBytes;
+
+struct BonePaletteBuffer
+{
+    u32 id;
+    i32 capacity;
+};
+
+BonePaletteBuffer CreateBonePaletteBuffer(i32 capacity)
+{
+    BonePaletteBuffer buffer = {};
+    buffer.capacity = capacity > 0 ? capacity : 1;
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, buffer.capacity * sizeof(glm::mat4), 0, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+void DestroyBonePaletteBuffer(BonePaletteBuffer *buffer)
+{
+    glDeleteBuffers(1, &buffer->id);
+    *buffer = {};
+}
+
+// one transfer for the whole palette
+void UploadBonePalette(BonePaletteBuffer *buffer, const glm::mat4 *matrices, i32 count)
+{
+    if(count <= 0) return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer->id);
+    if(count > buffer->capacity)
+    {
+        buffer->capacity = count;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(glm::mat4), matrices, GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::mat4), matrices);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gUploadedBytes += count * sizeof(glm::mat4);
+}
+
+void BindBonePalette(BonePaletteBuffer *buffer)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BONE_PALETTE_BINDING, buffer->id);
+}
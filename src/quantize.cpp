@@ -0,0 +1,272 @@
+// Quantized key blocks. Rotations are stored smallest three: the largest
+// component is dropped and rebuilt from the unit length, the other three lie
+// in [-1/sqrt(2), 1/sqrt(2)] and are stored in 15 bits each (48 bit keys) or
+// 10 bits each (32 bit keys), the index of the dropped component goes in the
+// two spare bits. Positions and scales are stored in 16 bits per component
+// against the range of their track. The tracks and times of the clip stay in
+// AnimationKeys, only the value blocks are replaced.
+
+#define SMALLEST_THREE_BOUND 0.70710678f
+#define QUANTIZED_VEC3_MAX 65535
+
+enum KeyCompression
+{
+    KEY_COMPRESSION_NONE,
+    KEY_COMPRESSION_48, // 48 bit rotations
+    KEY_COMPRESSION_32  // 32 bit rotations
+};
+
+// key = minimum + step * quantized
+struct QuantizedRange
+{
+    glm::vec3 minimum;
+    glm::vec3 step;
+};
+
+struct QuantizedKeys
+{
+    KeyCompression compression;
+    i32 rotationStride; // u16 per rotation key, 3 or 2
+
+    std::vector<u16> positions; // 3 per key
+    std::vector<u16> rotations; // rotationStride per key
+    std::vector<u16> scales;    // 3 per key
+
+    // one per track, track i belongs to bone i
+    std::vector<QuantizedRange> positionRanges;
+    std::vector<QuantizedRange> scaleRanges;
+};
+
+inline u32 QuantizeUnorm(f32 value, u32 maxValue)
+{
+    value = fminf(fmaxf(value, 0.0f), 1.0f);
+    return (u32)(value * (f32)maxValue + 0.5f);
+}
+
+inline glm::quat DecodeSmallestThree(u32 largest, f32 a, f32 b, f32 c)
+{
+    f32 d = sqrtf(fmaxf(1.0f - a * a - b * b - c * c, 0.0f));
+    switch(largest)
+    {
+        case 0: return glm::quat(c, d, a, b);
+        case 1: return glm::quat(c, a, d, b);
+        case 2: return glm::quat(c, a, b, d);
+        default: return glm::quat(d, a, b, c);
+    }
+}
+
+// the largest component goes in *largest, the other three in the order
+// x, y, z, w, quantized to bits each
+inline void EncodeSmallestThree(glm::quat rotation, u32 bits, u32 *largest, u32 *components)
+{
+    rotation = glm::normalize(rotation);
+    f32 values[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+    u32 largestIndex = 0;
+    for(u32 index = 1; index < 4; ++index)
+    {
+        if(fabsf(values[index]) > fabsf(values[largestIndex])) largestIndex = index;
+    }
+
+    // q and -q are the same rotation, keep the dropped component positive
+    f32 sign = values[largestIndex] < 0.0f ? -1.0f : 1.0f;
+    u32 maxValue = (1u << bits) - 1;
+    u32 count = 0;
+    for(u32 index = 0; index < 4; ++index)
+    {
+        if(index == largestIndex) continue;
+        f32 value = sign * values[index];
+        components[count++] = QuantizeUnorm(value / (2.0f * SMALLEST_THREE_BOUND) + 0.5f, maxValue);
+    }
+    *largest = largestIndex;
+}
+
+inline f32 DequantizeSmallestThree(u32 value, f32 maxValue)
+{
+    return ((f32)value / maxValue - 0.5f) * (2.0f * SMALLEST_THREE_BOUND);
+}
+
+// the dropped index is split over the high bit of the first two components
+inline void EncodeRotation48(const glm::quat &rotation, u16 *key)
+{
+    u32 largest, components[3];
+    EncodeSmallestThree(rotation, 15, &largest, components);
+    key[0] = (u16)(components[0] | ((largest & 1) << 15));
+    key[1] = (u16)(components[1] | ((largest >> 1) << 15));
+    key[2] = (u16)components[2];
+}
+
+inline void UnpackRotation48(const u16 *key, u32 *largest, u32 *components)
+{
+    *largest = (key[0] >> 15) | ((key[1] >> 15) << 1);
+    components[0] = key[0] & 0x7FFF;
+    components[1] = key[1] & 0x7FFF;
+    components[2] = key[2];
+}
+
+// 2 bit index and 3 x 10 bit components, low half first
+inline void EncodeRotation32(const glm::quat &rotation, u16 *key)
+{
+    u32 largest, components[3];
+    EncodeSmallestThree(rotation, 10, &largest, components);
+    u32 packed = (largest << 30) | (components[0] << 20) | (components[1] << 10) | components[2];
+    key[0] = (u16)(packed & 0xFFFF);
+    key[1] = (u16)(packed >> 16);
+}
+
+inline void UnpackRotation32(const u16 *key, u32 *largest, u32 *components)
+{
+    u32 packed = (u32)key[0] | ((u32)key[1] << 16);
+    *largest = packed >> 30;
+    components[0] = (packed >> 20) & 0x3FF;
+    components[1] = (packed >> 10) & 0x3FF;
+    components[2] = packed & 0x3FF;
+}
+
+inline f32 GetRotationMaxValue(const QuantizedKeys &quantized)
+{
+    return KEY_COMPRESSION_32 == quantized.compression ? 1023.0f : 32767.0f;
+}
+
+inline void UnpackRotation(const QuantizedKeys &quantized, i32 keyIndex, u32 *largest, u32 *components)
+{
+    const u16 *key = &quantized.rotations[keyIndex * quantized.rotationStride];
+    if(KEY_COMPRESSION_32 == quantized.compression)
+        UnpackRotation32(key, largest, components);
+    else
+        UnpackRotation48(key, largest, components);
+}
+
+inline glm::quat DecodeRotation(const QuantizedKeys &quantized, i32 keyIndex)
+{
+    u32 largest, components[3];
+    UnpackRotation(quantized, keyIndex, &largest, components);
+    f32 maxValue = GetRotationMaxValue(quantized);
+    return DecodeSmallestThree(largest,
+                               DequantizeSmallestThree(components[0], maxValue),
+                               DequantizeSmallestThree(components[1], maxValue),
+                               DequantizeSmallestThree(components[2], maxValue));
+}
+
+inline glm::vec3 DecodeVec3(const u16 *values, const QuantizedRange &range, i32 keyIndex)
+{
+    const u16 *key = &values[keyIndex * 3];
+    return range.minimum + range.step * glm::vec3((f32)key[0], (f32)key[1], (f32)key[2]);
+}
+
+internal void QuantizeVec3Track(const glm::vec3 *keys, i32 numKeys, std::vector<u16> &values,
+                                std::vector<QuantizedRange> &ranges)
+{
+    glm::vec3 minimum = keys[0];
+    glm::vec3 maximum = keys[0];
+    for(i32 keyIndex = 1; keyIndex < numKeys; ++keyIndex)
+    {
+        minimum = glm::min(minimum, keys[keyIndex]);
+        maximum = glm::max(maximum, keys[keyIndex]);
+    }
+
+    QuantizedRange range;
+    range.minimum = minimum;
+    range.step = (maximum - minimum) / (f32)QUANTIZED_VEC3_MAX;
+    ranges.push_back(range);
+
+    for(i32 keyIndex = 0; keyIndex < numKeys; ++keyIndex)
+    {
+        for(i32 component = 0; component < 3; ++component)
+        {
+            f32 extent = maximum[component] - minimum[component];
+            f32 value = extent > 0.0f ? (keys[keyIndex][component] - minimum[component]) / extent : 0.0f;
+            values.push_back((u16)QuantizeUnorm(value, QUANTIZED_VEC3_MAX));
+        }
+    }
+}
+
+// quantizes the value blocks of keys, the key offsets of the tracks index the
+// quantized blocks the same way they index the float ones. Reports the
+// largest error of the quantized keys
+void QuantizeAnimationKeys(const AnimationKeys &keys, KeyCompression compression, QuantizedKeys *quantized,
+                           f32 *positionError, f32 *rotationError, f32 *scaleError)
+{
+    Assert(compression != KEY_COMPRESSION_NONE);
+    *quantized = {};
+    quantized->compression = compression;
+    quantized->rotationStride = KEY_COMPRESSION_32 == compression ? 2 : 3;
+
+    i32 trackCount = (i32)keys.positionTracks.size();
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        const AnimationTrack &positionTrack = keys.positionTracks[trackIndex];
+        Assert(positionTrack.keyOffset * 3 == (i32)quantized->positions.size());
+        QuantizeVec3Track(&keys.positions[positionTrack.keyOffset], positionTrack.numKeys,
+                          quantized->positions, quantized->positionRanges);
+
+        const AnimationTrack &scaleTrack = keys.scaleTracks[trackIndex];
+        Assert(scaleTrack.keyOffset * 3 == (i32)quantized->scales.size());
+        QuantizeVec3Track(&keys.scales[scaleTrack.keyOffset], scaleTrack.numKeys,
+                          quantized->scales, quantized->scaleRanges);
+    }
+
+    quantized->rotations.resize(keys.rotations.size() * quantized->rotationStride);
+    for(i32 keyIndex = 0; keyIndex < (i32)keys.rotations.size(); ++keyIndex)
+    {
+        u16 *key = &quantized->rotations[keyIndex * quantized->rotationStride];
+        if(KEY_COMPRESSION_32 == compression)
+            EncodeRotation32(keys.rotations[keyIndex], key);
+        else
+            EncodeRotation48(keys.rotations[keyIndex], key);
+    }
+
+    *positionError = 0.0f;
+    *rotationError = 0.0f;
+    *scaleError = 0.0f;
+    for(i32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+    {
+        const AnimationTrack &positionTrack = keys.positionTracks[trackIndex];
+        const AnimationTrack &scaleTrack = keys.scaleTracks[trackIndex];
+        for(i32 keyIndex = positionTrack.keyOffset; keyIndex < positionTrack.keyOffset + positionTrack.numKeys; ++keyIndex)
+        {
+            glm::vec3 decoded = DecodeVec3(quantized->positions.data(), quantized->positionRanges[trackIndex], keyIndex);
+            *positionError = fmaxf(*positionError, glm::length(decoded - keys.positions[keyIndex]));
+        }
+        for(i32 keyIndex = scaleTrack.keyOffset; keyIndex < scaleTrack.keyOffset + scaleTrack.numKeys; ++keyIndex)
+        {
+            glm::vec3 decoded = DecodeVec3(quantized->scales.data(), quantized->scaleRanges[trackIndex], keyIndex);
+            *scaleError = fmaxf(*scaleError, glm::length(decoded - keys.scales[keyIndex]));
+        }
+    }
+    for(i32 keyIndex = 0; keyIndex < (i32)keys.rotations.size(); ++keyIndex)
+    {
+        f32 error = GetRotationError(DecodeRotation(*quantized, keyIndex), glm::normalize(keys.rotations[keyIndex]));
+        *rotationError = fmaxf(*rotationError, error);
+    }
+}
+
+u64 GetAnimationKeyBytes(const AnimationKeys &keys)
+{
+    return keys.times.size() * sizeof(f32) + keys.buckets.size() * sizeof(i32) +
+           keys.positions.size() * sizeof(glm::vec3) +
+           keys.rotations.size() * sizeof(glm::quat) +
+           keys.scales.size() * sizeof(glm::vec3);
+}
+
+u64 GetQuantizedKeyBytes(const QuantizedKeys &quantized)
+{
+    return (quantized.positions.size() + quantized.rotations.size() + quantized.scales.size()) * sizeof(u16) +
+           (quantized.positionRanges.size() + quantized.scaleRanges.size()) * sizeof(QuantizedRange);
+}
+
+void WriteConstantTracksQuantized(const AnimationKeys &keys, const QuantizedKeys &quantized, BoneTransform *localTransforms)
+{
+    for(i32 trackIndex = 0; trackIndex < (i32)keys.positionTracks.size(); ++trackIndex)
+    {
+        BoneTransform &transform = localTransforms[trackIndex];
+        const AnimationTrack &positionTrack = keys.positionTracks[trackIndex];
+        const AnimationTrack &rotationTrack = keys.rotationTracks[trackIndex];
+        const AnimationTrack &scaleTrack = keys.scaleTracks[trackIndex];
+        if(TRACK_KIND_CONSTANT == positionTrack.kind)
+            transform.translation = DecodeVec3(quantized.positions.data(), quantized.positionRanges[trackIndex], positionTrack.keyOffset);
+        if(TRACK_KIND_CONSTANT == rotationTrack.kind)
+            transform.rotation = DecodeRotation(quantized, rotationTrack.keyOffset);
+        if(TRACK_KIND_CONSTANT == scaleTrack.kind)
+            transform.scale = DecodeVec3(quantized.scales.data(), quantized.scaleRanges[trackIndex], scaleTrack.keyOffset);
+    }
+}
@@ -0,0 +1,132 @@
+// Batch pose sampler. The keys of SAMPLER_LANES tracks are gathered from the
+// key blocks and interpolated together, lerp for positions and scales and
+// nlerp for rotations, or a Hermite curve for cubic tracks. The lanes are
+// built twice from lanes.cpp, 8 AVX2 lanes and 4 SSE2 lanes, and the cpu
+// picks one at startup, so the build itself only needs SSE2.
+
+// finds the segment of every timeline of one kind for this sample
+template<TrackKind Kind>
+internal void SampleKindTimelines(const AnimationKeys &keys, f32 animationTime, TimelineCursor *cursors)
+{
+    for(i32 timelineIndex : keys.timelineBatches.tracks[Kind])
+    {
+        TimelineCursor &cursor = cursors[timelineIndex];
+        cursor.keyIndex = GetKindKeyIndex<Kind>(keys, keys.timelines[timelineIndex], animationTime,
+                                                cursor.searchIndex, &cursor.scaleFactor);
+    }
+}
+
+// one key search per timeline, the tracks read their segment from the cursor
+// of their timeline afterwards
+void SampleTimelines(const AnimationKeys &keys, f32 animationTime, TimelineCursor *cursors)
+{
+    SampleKindTimelines<TRACK_KIND_LINEAR_UNIFORM>(keys, animationTime, cursors);
+    SampleKindTimelines<TRACK_KIND_LINEAR_VARIABLE>(keys, animationTime, cursors);
+    SampleKindTimelines<TRACK_KIND_STEPPED>(keys, animationTime, cursors);
+    SampleKindTimelines<TRACK_KIND_CUBIC>(keys, animationTime, cursors);
+}
+
+// first and second key of the segment of the current sample, a stepped track
+// holds a single key so both are that key
+template<TrackKind Kind>
+inline void GetKindSegment(const TimelineCursor &cursor, i32 *first, i32 *second, f32 *scaleFactor)
+{
+    *first = cursor.keyIndex;
+    *scaleFactor = cursor.scaleFactor;
+    *second = *first + 1;
+    if(TRACK_KIND_STEPPED == Kind)
+    {
+        *first += (i32)*scaleFactor;
+        *second = *first;
+        *scaleFactor = 0.0f;
+    }
+}
+
+// the AVX2 lanes are compiled for AVX2 whatever the build targets, MSVC
+// emits the intrinsics as they are
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2
+{
+#define SAMPLER_AVX2 1
+#include "lanes.cpp"
+#undef SAMPLER_AVX2
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace sse2
+{
+#define SAMPLER_AVX2 0
+#include "lanes.cpp"
+#undef SAMPLER_AVX2
+}
+
+// AVX2 needs the cpu to have it and the os to save the ymm registers
+internal b8 CpuHasAVX2()
+{
+#ifdef _MSC_VER
+    i32 info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+    __cpuid(info, 1);
+    b8 osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if(!osSavesYmm) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+global_variable b8 gSamplerAVX2 = CpuHasAVX2();
+
+inline i32 GetSamplerLanes()
+{
+    return gSamplerAVX2 ? avx2::GetLaneCount() : sse2::GetLaneCount();
+}
+
+// samples the animated tracks of the clip in lanes, one batch per kind and
+// component after one key search per timeline. Constant tracks are never
+// touched, WriteConstantTracks puts them in the pose once
+void SamplePoseBatched(const AnimationKeys &keys, f32 animationTime,
+                       TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    if(gSamplerAVX2)
+        avx2::SamplePoseBatched(keys, animationTime, cursors, localTransforms);
+    else
+        sse2::SamplePoseBatched(keys, animationTime, cursors, localTransforms);
+}
+
+// same for quantized keys, decoded in lanes on the way in
+void SamplePoseQuantized(const AnimationKeys &keys, const QuantizedKeys &quantized, f32 animationTime,
+                         TimelineCursor *cursors, BoneTransform *localTransforms)
+{
+    if(gSamplerAVX2)
+        avx2::SamplePoseQuantized(keys, quantized, animationTime, cursors, localTransforms);
+    else
+        sse2::SamplePoseQuantized(keys, quantized, animationTime, cursors, localTransforms);
+}
+
+// writes the value of every constant track into the pose
+void WriteConstantTracks(const AnimationKeys &keys, BoneTransform *localTransforms)
+{
+    for(i32 trackIndex = 0; trackIndex < (i32)keys.positionTracks.size(); ++trackIndex)
+    {
+        BoneTransform &transform = localTransforms[trackIndex];
+        const AnimationTrack &positionTrack = keys.positionTracks[trackIndex];
+        const AnimationTrack &rotationTrack = keys.rotationTracks[trackIndex];
+        const AnimationTrack &scaleTrack = keys.scaleTracks[trackIndex];
+        if(TRACK_KIND_CONSTANT == positionTrack.kind) transform.translation = keys.positions[positionTrack.keyOffset];
+        if(TRACK_KIND_CONSTANT == rotationTrack.kind) transform.rotation = glm::normalize(keys.rotations[rotationTrack.keyOffset]);
+        if(TRACK_KIND_CONSTANT == scaleTrack.kind) transform.scale = keys.scales[scaleTrack.keyOffset];
+    }
+}
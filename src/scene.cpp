@@ -0,0 +1,60 @@
+// post processing the loaders ask for. A scene imported with more steps than
+// requested is reused, none of these steps touch the nodes or the animations
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace)
+#define ANIMATION_IMPORT_FLAGS (aiProcess_Triangulate)
+
+struct CachedScene
+{
+    std::string path;
+    u32 flags;
+    Assimp::Importer *importer; // owns the scene
+    const aiScene *scene;
+};
+
+// parsed scenes kept alive between the loaders that read the same file, so
+// a model and its clips cost one import. Nothing is freed until ReleaseScenes
+struct SceneCache
+{
+    std::vector<CachedScene> scenes;
+};
+
+// null if the file could not be imported
+const aiScene *ImportScene(SceneCache *cache, const std::string &path, u32 flags)
+{
+    for(const CachedScene &cached : cache->scenes)
+    {
+        if(cached.path == path && (cached.flags & flags) == flags)
+        {
+            return cached.scene;
+        }
+    }
+
+    Assimp::Importer *importer = new Assimp::Importer();
+    const aiScene *scene = importer->ReadFile(path, flags);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        printf("Error Loading %s\n", path.c_str());
+        printf("%s\n", importer->GetErrorString());
+        delete importer;
+        return nullptr;
+    }
+
+    CachedScene cached;
+    cached.path = path;
+    cached.flags = flags;
+    cached.importer = importer;
+    cached.scene = scene;
+    cache->scenes.push_back(cached);
+    return scene;
+}
+
+// frees every scene of the cache, the loaders copy what they need out of
+// them so this can run as soon as the last one was built
+void ReleaseScenes(SceneCache *cache)
+{
+    for(CachedScene &cached : cache->scenes)
+    {
+        delete cached.importer;
+    }
+    cache->scenes = std::vector<CachedScene>();
+}
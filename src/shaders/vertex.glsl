@@ -7,35 +7,58 @@ layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
 layout (location = 5) in ivec4 BoneIDs;
 layout (location = 6) in vec4 Weights;
+layout (location = 7) in vec4 aQTangent;
 
 uniform mat4 proj;
 uniform mat4 view;
 uniform mat4 world;
+// the mesh uses the packed layout, the tangent frame is in aQTangent then
+uniform bool packedVertices;
 
-const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 gBones[MAX_BONES];
+layout (std430, binding = 0) buffer BonePalette
+{
+    mat4 gBones[];
+};
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoord;
 out mat3 TBN;
 
+vec3 RotateByQuat(vec4 q, vec3 v)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main()
 {
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    vec3 bitangent = aBitangent;
+    if(packedVertices)
+    {
+        // the sign of w is the handedness of the bitangent
+        vec4 q = normalize(aQTangent);
+        tangent = RotateByQuat(q, vec3(1.0f, 0.0f, 0.0f));
+        normal = RotateByQuat(q, vec3(0.0f, 0.0f, 1.0f));
+        bitangent = cross(normal, tangent) * (aQTangent.w < 0.0f ? -1.0f : 1.0f);
+    }
+
     vec4 totalPosition = vec4(0.0f);
     vec3 totalNormal = vec3(0.0f);
     for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
     {
-        if(BoneIDs[i] == -1)
+        if(BoneIDs[i] == -1 || Weights[i] == 0.0f)
             continue;
-        if(BoneIDs[i] >= MAX_BONES)
+        if(BoneIDs[i] >= gBones.length())
         {
             totalPosition = vec4(aPos, 1.0f);
+            break;
         }
         vec4 localPosition = gBones[BoneIDs[i]] * vec4(aPos, 1.0f);
         totalPosition += localPosition * Weights[i];
-        vec3 localNormal = mat3(gBones[BoneIDs[i]]) * aNormal;
+        vec3 localNormal = mat3(gBones[BoneIDs[i]]) * normal;
         totalNormal += localNormal * Weights[i];
     }
 /*
@@ -46,10 +69,10 @@ void main()
 */
     gl_Position = proj * view * world * vec4(aPos, 1.0f);
     TexCoord = aTexCoord;
-    Normal = mat3(transpose(inverse(world))) * aNormal;
+    Normal = mat3(transpose(inverse(world))) * normal;
     FragPos = vec3(world * vec4(aPos, 1.0f));
-    vec3 T = normalize(vec3(world * vec4(aTangent, 0.0f)));
-    vec3 B = normalize(vec3(world * vec4(aBitangent, 0.0f)));
-    vec3 N = normalize(vec3(world * vec4(aNormal, 0.0f)));
+    vec3 T = normalize(vec3(world * vec4(tangent, 0.0f)));
+    vec3 B = normalize(vec3(world * vec4(bitangent, 0.0f)));
+    vec3 N = normalize(vec3(world * vec4(normal, 0.0f)));
     TBN = mat3(T, B, N);
 }
@@ -0,0 +1,51 @@
+// flat node hierarchy of an animation library, node i is stored at index i
+// of every array and a parent always comes before its children, so the
+// model space pose is one loop from the front to the back. The clips of the
+// library share it, each only maps the nodes to its own tracks
+struct Skeleton
+{
+    std::vector<i32> parents;                   // -1 for the root
+    std::vector<glm::mat4> bindTransforms;      // local transform when no track animates the node
+    std::vector<glm::mat4> inverseBindMatrices; // model space to bone space, identity if not skinned
+    std::vector<i32> paletteSlots;              // -1 if no vertex is skinned to the node
+    i32 paletteCount;
+};
+
+inline i32 GetNodeCount(const Skeleton &skeleton)
+{
+    return (i32)skeleton.parents.size();
+}
+
+inline i32 AddSkeletonNode(Skeleton &skeleton, i32 parent, const glm::mat4 &bindTransform)
+{
+    Assert(parent < GetNodeCount(skeleton));
+    skeleton.parents.push_back(parent);
+    skeleton.bindTransforms.push_back(bindTransform);
+    skeleton.inverseBindMatrices.push_back(glm::mat4(1.0f));
+    skeleton.paletteSlots.push_back(-1);
+    return GetNodeCount(skeleton) - 1;
+}
+
+// distance from every node to its farthest descendant in the bind pose, an
+// error in the local transform of a node moves its subtree by up to that much
+void GetSkeletonReach(const Skeleton &skeleton, std::vector<f32> &reaches)
+{
+    i32 nodeCount = GetNodeCount(skeleton);
+    std::vector<glm::mat4> modelTransforms(nodeCount);
+    reaches.assign(nodeCount, 0.0f);
+    for(i32 nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex)
+    {
+        i32 parent = skeleton.parents[nodeIndex];
+        if(parent < 0)
+            modelTransforms[nodeIndex] = skeleton.bindTransforms[nodeIndex];
+        else
+            modelTransforms[nodeIndex] = modelTransforms[parent] * skeleton.bindTransforms[nodeIndex];
+
+        glm::vec3 position = glm::vec3(modelTransforms[nodeIndex][3]);
+        for(i32 ancestor = parent; ancestor >= 0; ancestor = skeleton.parents[ancestor])
+        {
+            f32 distance = glm::length(position - glm::vec3(modelTransforms[ancestor][3]));
+            reaches[ancestor] = fmaxf(reaches[ancestor], distance);
+        }
+    }
+}